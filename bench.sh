@@ -0,0 +1,119 @@
+#!/bin/sh
+#
+# Boot the kernel headless, run the monitor's benchmark suite, and
+# compare each benchmark's median cycles per operation against a
+# stored baseline.
+#
+#	sh bench.sh [-v] [-u]
+#
+# -u replaces the baseline with this run's results.  The environment
+# may set
+#	BENCH_NAMES	benchmarks to run (default "all"; see 'bench' in
+#			the monitor)
+#	BENCH_SAMPLES	samples per benchmark (default 11)
+#	BENCH_BASELINE	the baseline file (default conf/bench.baseline)
+#	BENCH_THRESHOLD	percent slowdown past which a benchmark counts
+#			as a regression (default 10)
+# With no baseline yet, the results become the baseline.  Exits with
+# status 1 if any benchmark regressed.  Cycle counts depend on the
+# host, so baselines are local and not kept in the repository.
+
+qemuopts="-hda obj/kern/kernel.img"
+. ./grade-functions.sh		# takes -v from our arguments
+
+update=false
+for arg; do
+	if [ "x$arg" = "x-u" ]; then
+		update=true
+	fi
+done
+
+names=${BENCH_NAMES:-all}
+samples=${BENCH_SAMPLES:-11}
+baseline=${BENCH_BASELINE:-conf/bench.baseline}
+threshold=${BENCH_THRESHOLD:-10}
+results=obj/bench.results
+timeout=300
+
+$make || exit 1
+
+# Wait up to $2 seconds for a line matching $1 in jos.out.
+waitfor () {
+	n=0
+	while ! tr -d '\r' < jos.out 2>/dev/null | grep -q "$1"; do
+		n=`expr $n + 1`
+		if [ $n -gt $2 ]; then
+			return 1
+		fi
+		sleep 1
+	done
+}
+
+# Like run in grade-functions.sh, but with the serial console on a pipe
+# we type monitor commands into, and on jos.out.
+rm -f jos.out jos.in
+mkfifo jos.in
+t0=`date +%s.%N 2>/dev/null`
+(
+	ulimit -t $timeout
+	exec $qemu -nographic $qemuopts -serial stdio -monitor null -no-reboot
+) <jos.in >jos.out 2>$err &
+PID=$!
+exec 3>jos.in
+
+ok=true
+if ! waitfor '^K> ' 60; then
+	echo "bench: no monitor prompt (see jos.out)"
+	ok=false
+else
+	echo "bench -m -n $samples $names" >&3
+	if ! waitfor '^@bench end' $timeout; then
+		echo "bench: suite did not finish (see jos.out)"
+		ok=false
+	fi
+fi
+exec 3>&-
+kill $PID >/dev/null 2>&1
+rm -f jos.in
+$ok || exit 1
+
+# The result block: "@bench name ops samples min median max", in
+# tenths of a cycle.  Keep name and median.
+tr -d '\r' < jos.out | awk '$1 == "@bench" && NF == 7 { print $2, $6 }' > $results
+if [ ! -s $results ]; then
+	echo "bench: no results (see jos.out)"
+	exit 1
+fi
+
+if $update || [ ! -f $baseline ]; then
+	cp $results $baseline
+	echo "bench: saved $baseline"
+	exit 0
+fi
+
+awk -v thr=$threshold '
+	NR == FNR { base[$1] = $2; next }
+	FNR == 1 {
+		printf("%-14s %10s %10s %8s  (median cycles/op, limit +%d%%)\n",
+		       "benchmark", "baseline", "now", "change", thr)
+	}
+	{
+		if (!($1 in base) || base[$1] == 0) {
+			printf("%-14s %10s %10.1f %8s\n", $1, "-", $2 / 10, "new")
+			next
+		}
+		change = ($2 - base[$1]) * 100 / base[$1]
+		printf("%-14s %10.1f %10.1f %+7.1f%%", $1, base[$1] / 10,
+		       $2 / 10, change)
+		if (change > thr) {
+			printf("  REGRESSED")
+			bad++
+		}
+		printf("\n")
+	}
+	END {
+		if (bad) {
+			printf("bench: %d regression(s) past %d%%\n", bad, thr)
+			exit 1
+		}
+	}' $baseline $results
@@ -1,23 +1,26 @@
 #include <inc/x86.h>
-#include <inc/elf.h>
+#include <inc/bootinfo.h>
 
 /**********************************************************************
- * This a dirt simple boot loader, whose sole job is to boot
- * an ELF kernel image from the first IDE hard disk.
+ * This a dirt simple boot loader, whose sole job is to load the
+ * second-stage loader (boot/stage2.c) from the first IDE hard disk.
  *
  * DISK LAYOUT
  *  * This program(boot.S and main.c) is the bootloader.  It should
  *    be stored in the first sector of the disk.
- * 
- *  * The 2nd sector onward holds the kernel image.
- *	
+ *
+ *  * The next BOOT2_NSECT sectors hold the second-stage loader,
+ *    start2.S and stage2.c, as a flat binary linked at BOOT2_ADDR.
+ *
+ *  * The sectors after that hold the kernel image.
+ *
  *  * The kernel image must be in ELF format.
  *
- * BOOT UP STEPS	
+ * BOOT UP STEPS
  *  * when the CPU boots it loads the BIOS into memory and executes it
  *
  *  * the BIOS intializes devices, sets of the interrupt routines, and
- *    reads the first sector of the boot device(e.g., hard-drive) 
+ *    reads the first sector of the boot device(e.g., hard-drive)
  *    into memory and jumps to it.
  *
  *  * Assuming this boot loader is stored in the first sector of the
@@ -26,71 +29,55 @@
  *  * control starts in boot.S -- which sets up protected mode,
  *    and a stack so C code then run, then calls bootmain()
  *
- *  * bootmain() in this file takes over, reads in the kernel and jumps to it.
+ *  * bootmain() in this file takes over, reads in the second stage
+ *    and jumps to it.
+ *
+ *  * the second stage reads in the kernel and jumps to it.
  **********************************************************************/
 
 #define SECTSIZE	512
-#define ELFHDR		((struct Elf *) 0x10000) // scratch space
 
-void readsect(void*, uint32_t);
-void readseg(uint32_t, uint32_t, uint32_t);
+#define MULTSECT	16	// sectors per DRQ block in multiple mode
+
+#define IDE_CMD_READ		0x20	// read sectors, one per DRQ block
+#define IDE_CMD_READ_MULTIPLE	0xC4	// read sectors, MULTSECT per DRQ block
+#define IDE_CMD_SET_MULTIPLE	0xC6
+
+static void readsect(uint8_t*, uint32_t, uint32_t);
+static void waitdisk(void);
+
+// READ MULTIPLE, or READ SECTORS if the drive has no multiple mode.
+static uint8_t readcmd = IDE_CMD_READ_MULTIPLE;
 
 void
 bootmain(void)
 {
-	struct Proghdr *ph, *eph;
-
-	// read 1st page off disk
-	readseg((uint32_t) ELFHDR, SECTSIZE*8, 0);
+	((struct Bootinfo *) BOOTINFO_ADDR)->bi_tsc[BOOT_TS_BOOTMAIN] = read_tsc();
 
-	// is this a valid ELF?
-	if (ELFHDR->e_magic != ELF_MAGIC)
-		goto bad;
+	// Switch the drive into multiple mode, so that it transfers
+	// MULTSECT sectors per DRQ block instead of interrupting and
+	// re-arming after every sector.  Drives that refuse (ERR set)
+	// fall back to plain READ SECTORS.
+	waitdisk();
+	outb(0x1F2, MULTSECT);
+	outb(0x1F6, 0xE0);
+	outb(0x1F7, IDE_CMD_SET_MULTIPLE);
+	waitdisk();
+	if (inb(0x1F7) & 1)
+		readcmd = IDE_CMD_READ;
 
-	// load each program segment (ignores ph flags)
-	ph = (struct Proghdr *) ((uint8_t *) ELFHDR + ELFHDR->e_phoff);
-	eph = ph + ELFHDR->e_phnum;
-	for (; ph < eph; ph++)
-		readseg(ph->p_va, ph->p_memsz, ph->p_offset);
+	// read the second stage off disk, right after the boot sector
+	readsect((uint8_t *) BOOT2_ADDR, 1, BOOT2_NSECT);
 
-	// call the entry point from the ELF header
+	// call its entry point
 	// note: does not return!
-	((void (*)(void)) (ELFHDR->e_entry & 0xFFFFFF))();
+	((void (*)(void)) BOOT2_ADDR)();
 
-bad:
-	outw(0x8A00, 0x8A00);
-	outw(0x8A00, 0x8E00);
 	while (1)
 		/* do nothing */;
 }
 
-// Read 'count' bytes at 'offset' from kernel into virtual address 'va'.
-// Might copy more than asked
-void
-readseg(uint32_t va, uint32_t count, uint32_t offset)
-{
-	uint32_t end_va;
-
-	va &= 0xFFFFFF;
-	end_va = va + count;
-	
-	// round down to sector boundary
-	va &= ~(SECTSIZE - 1);
-
-	// translate from bytes to sectors, and kernel starts at sector 1
-	offset = (offset / SECTSIZE) + 1;
-
-	// If this is too slow, we could read lots of sectors at a time.
-	// We'd write more to memory than asked, but it doesn't matter --
-	// we load in increasing order.
-	while (va < end_va) {
-		readsect((uint8_t*) va, offset);
-		va += SECTSIZE;
-		offset++;
-	}
-}
-
-void
+static void
 waitdisk(void)
 {
 	// wait for disk reaady
@@ -98,23 +85,26 @@ waitdisk(void)
 		/* do nothing */;
 }
 
-void
-readsect(void *dst, uint32_t offset)
+// Read 'count' (1..256) sectors starting at sector 'offset' into 'dst'.
+static void
+readsect(uint8_t *dst, uint32_t offset, uint32_t count)
 {
 	// wait for disk to be ready
 	waitdisk();
 
-	outb(0x1F2, 1);		// count = 1
+	outb(0x1F2, count);	// count; 256 wraps to 0, which means 256
 	outb(0x1F3, offset);
 	outb(0x1F4, offset >> 8);
 	outb(0x1F5, offset >> 16);
 	outb(0x1F6, (offset >> 24) | 0xE0);
-	outb(0x1F7, 0x20);	// cmd 0x20 - read sectors
-
-	// wait for disk to be ready
-	waitdisk();
-
-	// read a sector
-	insl(0x1F0, dst, SECTSIZE/4);
+	outb(0x1F7, readcmd);
+
+	// Read the sectors.  Within a DRQ block the drive stays ready,
+	// so polling once per sector costs a single inb.
+	for (; count > 0; count--) {
+		waitdisk();
+		insl(0x1F0, dst, SECTSIZE/4);
+		dst += SECTSIZE;
+	}
 }
 
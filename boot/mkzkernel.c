@@ -0,0 +1,195 @@
+/*
+ * mkzkernel: build a compressed kernel image for the boot loader.
+ *
+ *	mkzkernel kernel kernel.lz4
+ *
+ * Reads the ELF kernel, compresses the file contents of each loadable
+ * segment in LZ4 block format, and writes them after a struct Zkernel
+ * header (see inc/zkernel.h).  boot/stage2.c inflates the segments to
+ * their load addresses.  This is a host program, built with $(NCC).
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <inc/elf.h>
+#include <inc/zkernel.h>
+
+// LZ4 block format parameters
+#define MINMATCH	4	// shortest match
+#define LASTLITERALS	5	// the last 5 bytes are always literals
+#define MFLIMIT		12	// no match may start in the last 12 bytes
+#define MAXOFFSET	65535
+#define HASHBITS	16
+
+static uint8_t *
+readfile(const char *name, size_t *lenp)
+{
+	FILE *f;
+	uint8_t *buf;
+	long len;
+
+	if ((f = fopen(name, "rb")) == NULL
+	    || fseek(f, 0, SEEK_END) < 0 || (len = ftell(f)) < 0
+	    || fseek(f, 0, SEEK_SET) < 0) {
+		perror(name);
+		exit(1);
+	}
+	if ((buf = malloc(len)) == NULL || fread(buf, 1, len, f) != len) {
+		fprintf(stderr, "%s: short read\n", name);
+		exit(1);
+	}
+	fclose(f);
+	*lenp = len;
+	return buf;
+}
+
+static uint32_t
+read32(const uint8_t *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, 4);
+	return v;
+}
+
+// Emit an LZ4 length continuation: runs of 255, then the remainder.
+static uint8_t *
+putlen(uint8_t *op, size_t len)
+{
+	for (; len >= 255; len -= 255)
+		*op++ = 255;
+	*op++ = len;
+	return op;
+}
+
+// Emit one sequence: literals [lit, lit+nlit), then (unless mlen is 0)
+// a match of mlen bytes at distance off.
+static uint8_t *
+putseq(uint8_t *op, const uint8_t *lit, size_t nlit, size_t off, size_t mlen)
+{
+	uint8_t *token = op++;
+
+	*token = (nlit < 15 ? nlit : 15) << 4;
+	if (nlit >= 15)
+		op = putlen(op, nlit - 15);
+	memcpy(op, lit, nlit);
+	op += nlit;
+	if (mlen == 0)
+		return op;
+
+	*op++ = off;
+	*op++ = off >> 8;
+	mlen -= MINMATCH;
+	*token |= (mlen < 15 ? mlen : 15);
+	if (mlen >= 15)
+		op = putlen(op, mlen - 15);
+	return op;
+}
+
+// Greedy LZ4 block compressor with a single-entry hash table.
+// 'out' must have room for n + n/255 + 16 bytes.
+// Returns the compressed size.
+static size_t
+lz4_compress(const uint8_t *in, size_t n, uint8_t *out)
+{
+	static uint32_t table[1 << HASHBITS];	// position + 1, or 0
+	size_t ip, anchor, ref, mlen;
+	uint32_t seq, h;
+	uint8_t *op = out;
+
+	memset(table, 0, sizeof(table));
+	ip = anchor = 0;
+	while (n >= MFLIMIT + 1 && ip <= n - MFLIMIT) {
+		seq = read32(in + ip);
+		h = (seq * 2654435761U) >> (32 - HASHBITS);
+		ref = table[h];
+		table[h] = ip + 1;
+		if (ref == 0 || ip - (ref - 1) > MAXOFFSET
+		    || read32(in + ref - 1) != seq) {
+			ip++;
+			continue;
+		}
+		ref--;
+		for (mlen = MINMATCH;
+		     ip + mlen < n - LASTLITERALS && in[ref + mlen] == in[ip + mlen];
+		     mlen++)
+			/* do nothing */;
+		op = putseq(op, in + anchor, ip - anchor, ip - ref, mlen);
+		ip += mlen;
+		anchor = ip;
+	}
+	op = putseq(op, in + anchor, n - anchor, 0, 0);
+	return op - out;
+}
+
+int
+main(int argc, char **argv)
+{
+	struct Elf *elf;
+	struct Proghdr *ph;
+	struct Zkernel zk;
+	struct Zksegment *zs;
+	uint8_t *kern, *out, *op;
+	size_t kernlen, outmax;
+	FILE *f;
+	int i;
+
+	if (argc != 3) {
+		fprintf(stderr, "usage: mkzkernel kernel kernel.lz4\n");
+		exit(2);
+	}
+
+	kern = readfile(argv[1], &kernlen);
+	elf = (struct Elf *) kern;
+	if (kernlen < sizeof(*elf) || elf->e_magic != ELF_MAGIC
+	    || elf->e_phoff + elf->e_phnum * sizeof(*ph) > kernlen) {
+		fprintf(stderr, "%s: not an ELF kernel\n", argv[1]);
+		exit(1);
+	}
+
+	outmax = kernlen + kernlen / 255 + 16 * ZK_MAXSEG;
+	if ((out = malloc(outmax)) == NULL) {
+		perror("malloc");
+		exit(1);
+	}
+
+	memset(&zk, 0, sizeof(zk));
+	zk.zk_magic = ZKERNEL_MAGIC;
+	zk.zk_entry = elf->e_entry;
+	op = out;
+	ph = (struct Proghdr *) (kern + elf->e_phoff);
+	for (i = 0; i < elf->e_phnum; i++, ph++) {
+		if (ph->p_type != ELF_PROG_LOAD)
+			continue;
+		if (zk.zk_nseg == ZK_MAXSEG) {
+			fprintf(stderr, "%s: too many segments\n", argv[1]);
+			exit(1);
+		}
+		if (ph->p_offset + ph->p_filesz > kernlen) {
+			fprintf(stderr, "%s: truncated segment\n", argv[1]);
+			exit(1);
+		}
+		zs = &zk.zk_seg[zk.zk_nseg++];
+		zs->zs_va = ph->p_va;
+		zs->zs_filesz = ph->p_filesz;
+		zs->zs_memsz = ph->p_memsz;
+		zs->zs_csize = lz4_compress(kern + ph->p_offset, ph->p_filesz, op);
+		op += zs->zs_csize;
+	}
+	zk.zk_size = sizeof(zk) + (op - out);
+
+	if ((f = fopen(argv[2], "wb")) == NULL
+	    || fwrite(&zk, sizeof(zk), 1, f) != 1
+	    || fwrite(out, 1, op - out, f) != op - out
+	    || fclose(f) != 0) {
+		perror(argv[2]);
+		exit(1);
+	}
+
+	fprintf(stderr, "%s is %u bytes (%s is %lu bytes)\n",
+		argv[2], zk.zk_size, argv[1], (unsigned long) kernlen);
+	return 0;
+}
@@ -0,0 +1,482 @@
+#include <inc/x86.h>
+#include <inc/elf.h>
+#include <inc/bootinfo.h>
+#include <inc/zkernel.h>
+
+/**********************************************************************
+ * Second-stage boot loader.  boot/main.c loads this code from the
+ * BOOT2_NSECT sectors following the boot sector; its job is to load
+ * the kernel stored after it and jump to the kernel's entry point.
+ *
+ * The kernel is either an ELF image, or a compressed image built by
+ * boot/mkzkernel (see inc/zkernel.h), which is read into memory whole
+ * and then inflated to the kernel's load addresses.
+ *
+ * Unlike the boot sector, this stage has room to use the disk well:
+ *
+ *  * If the IDE controller is a PCI bus master (e.g. the PIIX that
+ *    QEMU emulates), sectors are moved by DMA through a physical
+ *    region descriptor (PRD) table, many megabytes per command.
+ *
+ *  * Otherwise, or if a DMA transfer never finishes, it falls back
+ *    to PIO, still with multi-sector commands where it can.
+ *
+ *  * Drives that support it are addressed with 48-bit LBAs, so the
+ *    kernel is not confined to the 28-bit LBA window.
+ **********************************************************************/
+
+#define SECTSIZE	512
+#define KERNSECT	(1 + BOOT2_NSECT)	// kernel starts here on disk
+#define ELFHDR		((struct Elf *) 0x10000) // scratch space
+
+// Physical address at which to load a kernel virtual address.
+// The kernel is linked at KERNBASE (0xF0000000) + its physical address.
+#define LOADADDR(va)	((va) & 0x0FFFFFFF)
+
+// ATA task file registers (primary channel) and commands
+#define IDE_DATA	0x1F0
+#define IDE_NSECT	0x1F2
+#define IDE_LBA0	0x1F3
+#define IDE_LBA1	0x1F4
+#define IDE_LBA2	0x1F5
+#define IDE_DRIVE	0x1F6
+#define IDE_CMD		0x1F7	// write: command
+#define IDE_STATUS	0x1F7	// read: status
+#define   IDE_BSY	0x80
+#define   IDE_DRDY	0x40
+#define   IDE_ERR	0x01
+#define IDE_CTL		0x3F6	// write: device control
+#define   IDE_CTL_NIEN	0x02	// mask the drive's interrupt
+#define   IDE_CTL_SRST	0x04	// software reset
+
+#define IDE_CMD_READ		0x20
+#define IDE_CMD_READ_EXT	0x24
+#define IDE_CMD_READ_DMA_EXT	0x25
+#define IDE_CMD_READ_MULTIPLE_EXT 0x29
+#define IDE_CMD_READ_MULTIPLE	0xC4
+#define IDE_CMD_READ_DMA	0xC8
+#define IDE_CMD_IDENTIFY	0xEC
+
+// IDENTIFY DEVICE words we care about
+#define ID_CAPABILITIES	49
+#define   ID_CAP_DMA	0x0100
+#define ID_MULTSECT	59	// current READ MULTIPLE setting
+#define   ID_MULT_VALID	0x0100
+#define ID_CMDSET2	83
+#define   ID_CMD_LBA48	0x0400
+
+// PCI configuration space access
+#define PCI_CONF_ADDR	0xCF8
+#define PCI_CONF_DATA	0xCFC
+#define PCI_COMMAND	0x04
+#define   PCI_CMD_IO	0x0001
+#define   PCI_CMD_MASTER 0x0004
+#define PCI_CLASS	0x08
+#define PCI_BAR4	0x20
+
+// PCI IDE bus master registers (primary channel), relative to BAR4
+#define BM_CMD		0
+#define   BM_CMD_START	0x01
+#define   BM_CMD_WRITE	0x08	// bus master writes to memory (disk read)
+#define BM_STATUS	2
+#define   BM_ST_ACTIVE	0x01
+#define   BM_ST_ERR	0x02
+#define   BM_ST_INTR	0x04
+#define BM_PRDT		4
+
+// Physical region descriptor.  A region must not cross a 64KB
+// boundary; a length of 0 means 64KB.
+struct Prd {
+	uint32_t pr_addr;
+	uint16_t pr_len;
+	uint16_t pr_flags;
+#define PRD_EOT		0x8000	// last descriptor in the table
+};
+
+#define NPRD		32
+
+// Give up on a DMA transfer that has not finished after this many TSC
+// cycles (a second or more on any CPU that runs JOS), and use PIO.
+#define DMA_TIMEOUT	(1ULL << 32)
+
+static struct Prd prdt[NPRD] __attribute__((aligned(8)));
+static uint16_t bmbase;		// bus master I/O base, 0 if none
+static bool lba48;
+static uint8_t pio_cmd;
+
+static void ide_init(void);
+static void readseg(uint32_t, uint32_t, uint32_t);
+static uint32_t ide_read(uint32_t, uint32_t, uint32_t);
+static uint32_t load_elf(struct Elf *);
+static void zero(uint32_t, uint32_t);
+static uint32_t load_zkernel(struct Zkernel *);
+static void bad(void) __attribute__((noreturn));
+
+void
+stage2main(void)
+{
+	struct Bootinfo *bi = (struct Bootinfo *) BOOTINFO_ADDR;
+	uint32_t entry;
+
+	bi->bi_tsc[BOOT_TS_STAGE2] = read_tsc();
+	bi->bi_flags = BI_TSC;
+	if (bi->bi_nmmap > 0)
+		bi->bi_flags |= BI_MMAP;
+
+	ide_init();
+
+	// read 1st page off disk
+	readseg((uint32_t) ELFHDR, SECTSIZE*8, 0);
+
+	// is this a valid ELF, or a compressed kernel?
+	if (ELFHDR->e_magic == ELF_MAGIC)
+		entry = load_elf(ELFHDR);
+	else if (ELFHDR->e_magic == ZKERNEL_MAGIC)
+		entry = load_zkernel((struct Zkernel *) ELFHDR);
+	else
+		bad();
+
+	bi->bi_tsc[BOOT_TS_LOADED] = read_tsc();
+
+	// call the entry point, telling the kernel its BSS is already clear
+	// and where to find the Bootinfo
+	// note: does not return!
+	__asm __volatile("jmp *%0" : : "r" (LOADADDR(entry)),
+			 "a" (JOS_BOOT_MAGIC), "b" (bi));
+}
+
+// Load an ELF kernel whose first page is at 'elf'.
+// Returns its entry point.
+static uint32_t
+load_elf(struct Elf *elf)
+{
+	struct Proghdr *ph, *eph;
+
+	// load each program segment (ignores ph flags): read the file
+	// part off disk, then zero the rest of the segment (e.g. BSS)
+	ph = (struct Proghdr *) ((uint8_t *) elf + elf->e_phoff);
+	eph = ph + elf->e_phnum;
+	for (; ph < eph; ph++) {
+		readseg(ph->p_va, ph->p_filesz, ph->p_offset);
+		zero(LOADADDR(ph->p_va + ph->p_filesz),
+		     ph->p_memsz - ph->p_filesz);
+	}
+	return elf->e_entry;
+}
+
+// Zero exactly 'n' bytes at physical address 'pa', a word at a time
+// and then the odd bytes.  Nothing past them may be touched: in
+// load_zkernel() the compressed image can start right there.
+static void
+zero(uint32_t pa, uint32_t n)
+{
+	stosl((void *) pa, 0, n / 4);
+	stosb((void *) (pa + (n & ~3)), 0, n % 4);
+}
+
+// Inflate one LZ4 block of 'len' bytes at 'src' into 'dst'.
+static void
+lz4_decode(const uint8_t *src, uint32_t len, uint8_t *dst)
+{
+	const uint8_t *end = src + len, *match;
+	uint32_t token, n, b;
+
+	while (src < end) {
+		token = *src++;
+
+		// literal run, with 255-byte length continuations
+		n = token >> 4;
+		if (n == 15)
+			do {
+				n += (b = *src++);
+			} while (b == 255);
+		__asm __volatile("cld; rep movsb"
+				 : "+D" (dst), "+S" (src), "+c" (n)
+				 : : "memory", "cc");
+
+		// the last sequence has no match
+		if (src >= end)
+			break;
+
+		// match copy; it may overlap its own output, so go bytewise
+		match = dst - (src[0] | (src[1] << 8));
+		src += 2;
+		n = token & 15;
+		if (n == 15)
+			do {
+				n += (b = *src++);
+			} while (b == 255);
+		for (n += 4; n > 0; n--)
+			*dst++ = *match++;
+	}
+}
+
+// Load a compressed kernel whose first page is at 'zk'.
+// Returns its entry point.
+static uint32_t
+load_zkernel(struct Zkernel *zk)
+{
+	struct Zksegment *zs;
+	uint32_t scratch, i;
+	uint8_t *src;
+
+	// Read the whole image in just past the highest byte that any
+	// segment will occupy, then inflate the segments out of it.
+	scratch = 0;
+	for (i = 0; i < zk->zk_nseg; i++) {
+		zs = &zk->zk_seg[i];
+		scratch = MAX(scratch, LOADADDR(zs->zs_va + zs->zs_memsz));
+	}
+	scratch = ROUNDUP(scratch, SECTSIZE);
+	readseg(scratch, zk->zk_size, 0);
+
+	zk = (struct Zkernel *) scratch;
+	src = (uint8_t *) (zk + 1);
+	for (i = 0; i < zk->zk_nseg; i++) {
+		zs = &zk->zk_seg[i];
+		lz4_decode(src, zs->zs_csize, (uint8_t *) LOADADDR(zs->zs_va));
+		zero(LOADADDR(zs->zs_va + zs->zs_filesz),
+		     zs->zs_memsz - zs->zs_filesz);
+		src += zs->zs_csize;
+	}
+	return zk->zk_entry;
+}
+
+static void
+bad(void)
+{
+	outw(0x8A00, 0x8A00);
+	outw(0x8A00, 0x8E00);
+	while (1)
+		/* do nothing */;
+}
+
+// Read 'count' bytes at 'offset' from kernel into virtual address 'va'.
+// Might copy more than asked
+static void
+readseg(uint32_t va, uint32_t count, uint32_t offset)
+{
+	uint32_t pa, end_pa, sect, nsect, n;
+
+	pa = LOADADDR(va);
+	end_pa = pa + count;
+
+	// round down to sector boundary
+	pa &= ~(SECTSIZE - 1);
+
+	// translate from bytes to sectors
+	sect = (offset / SECTSIZE) + KERNSECT;
+	nsect = (end_pa - pa + SECTSIZE - 1) / SECTSIZE;
+
+	// We'd write more to memory than asked, but it doesn't matter --
+	// we load in increasing order.
+	while (nsect > 0) {
+		n = ide_read(pa, sect, nsect);
+		pa += n * SECTSIZE;
+		sect += n;
+		nsect -= n;
+	}
+}
+
+
+/***** IDE disk access *****/
+
+static void
+waitdisk(void)
+{
+	// wait for disk ready
+	while ((inb(IDE_STATUS) & (IDE_BSY|IDE_DRDY)) != IDE_DRDY)
+		/* do nothing */;
+}
+
+static uint32_t
+pci_conf_read(uint32_t tag, int reg)
+{
+	outl(PCI_CONF_ADDR, tag | reg);
+	return inl(PCI_CONF_DATA);
+}
+
+static void
+pci_conf_write(uint32_t tag, int reg, uint32_t v)
+{
+	outl(PCI_CONF_ADDR, tag | reg);
+	outl(PCI_CONF_DATA, v);
+}
+
+// Find a bus-master-capable PCI IDE controller on bus 0 and
+// return the I/O base of its bus master registers, or 0.
+static uint16_t
+pci_find_busmaster(void)
+{
+	uint32_t tag, class;
+
+	for (tag = 0x80000000; tag < 0x80010000; tag += 0x100) {
+		class = pci_conf_read(tag, PCI_CLASS);
+		// class 01 (mass storage), subclass 01 (IDE),
+		// programming interface bit 7 (bus master capable)
+		if ((class >> 16) != 0x0101 || !(class & 0x8000))
+			continue;
+		pci_conf_write(tag, PCI_COMMAND,
+			       pci_conf_read(tag, PCI_COMMAND)
+			       | PCI_CMD_IO | PCI_CMD_MASTER);
+		return pci_conf_read(tag, PCI_BAR4) & 0xFFFC;
+	}
+	return 0;
+}
+
+// Decide how to talk to the disk: DMA or PIO, 48- or 28-bit LBAs.
+static void
+ide_init(void)
+{
+	uint16_t id[SECTSIZE/2];
+
+	waitdisk();
+	outb(IDE_DRIVE, 0xE0);
+	outb(IDE_CMD, IDE_CMD_IDENTIFY);
+	waitdisk();
+	insl(IDE_DATA, id, SECTSIZE/4);
+
+	lba48 = (id[ID_CMDSET2] & ID_CMD_LBA48) != 0;
+
+	// The bus master's interrupt bit follows the drive's INTRQ, which
+	// nIEN holds low, so let the drive interrupt.  The PIC still has
+	// IRQ 14 masked and the CPU runs with interrupts off.
+	outb(IDE_CTL, 0);
+
+	// boot/main.c left the drive in multiple mode if it could
+	if ((id[ID_MULTSECT] & ID_MULT_VALID) && (id[ID_MULTSECT] & 0xFF))
+		pio_cmd = lba48 ? IDE_CMD_READ_MULTIPLE_EXT
+				: IDE_CMD_READ_MULTIPLE;
+	else
+		pio_cmd = lba48 ? IDE_CMD_READ_EXT : IDE_CMD_READ;
+
+	if (id[ID_CAPABILITIES] & ID_CAP_DMA)
+		bmbase = pci_find_busmaster();
+}
+
+// Issue an ATA read command for 'nsect' sectors at 'sect'.
+static void
+ide_command(uint8_t cmd, uint32_t sect, uint32_t nsect)
+{
+	waitdisk();
+	if (lba48) {
+		// high-order bytes first, then the low-order bytes
+		outb(IDE_NSECT, nsect >> 8);
+		outb(IDE_LBA0, sect >> 24);
+		outb(IDE_LBA1, 0);
+		outb(IDE_LBA2, 0);
+		outb(IDE_NSECT, nsect);
+		outb(IDE_LBA0, sect);
+		outb(IDE_LBA1, sect >> 8);
+		outb(IDE_LBA2, sect >> 16);
+		outb(IDE_DRIVE, 0x40);
+	} else {
+		outb(IDE_NSECT, nsect);
+		outb(IDE_LBA0, sect);
+		outb(IDE_LBA1, sect >> 8);
+		outb(IDE_LBA2, sect >> 16);
+		outb(IDE_DRIVE, (sect >> 24) | 0xE0);
+	}
+	outb(IDE_CMD, cmd);
+}
+
+// Give up on DMA: reset the drive, which may be stuck in the middle
+// of a command, and read by PIO from now on.  The reset cancels any
+// READ MULTIPLE setting, so read a sector per command.
+static void
+ide_dma_fail(void)
+{
+	int i;
+
+	outb(bmbase + BM_CMD, 0);
+	bmbase = 0;
+	outb(IDE_CTL, IDE_CTL_SRST);
+	for (i = 0; i < 8; i++)		// hold reset for at least 5us
+		inb(IDE_STATUS);
+	outb(IDE_CTL, 0);
+	pio_cmd = lba48 ? IDE_CMD_READ_EXT : IDE_CMD_READ;
+}
+
+// Read sectors by bus master DMA directly into physical memory.
+// Returns the number of sectors read, which may be fewer than asked
+// if the PRD table fills up, or 0 if the transfer timed out.
+static uint32_t
+ide_read_dma(uint32_t pa, uint32_t sect, uint32_t nsect)
+{
+	uint32_t len, n;
+	uint64_t deadline;
+	int i;
+
+	// Describe the destination, splitting it at 64KB boundaries.
+	for (i = 0, n = 0; i < NPRD && n < nsect; i++) {
+		len = 0x10000 - (pa & 0xFFFF);
+		if (len > (nsect - n) * SECTSIZE)
+			len = (nsect - n) * SECTSIZE;
+		prdt[i].pr_addr = pa;
+		prdt[i].pr_len = len;
+		prdt[i].pr_flags = 0;
+		pa += len;
+		n += len / SECTSIZE;
+	}
+	prdt[i - 1].pr_flags = PRD_EOT;
+
+	outl(bmbase + BM_PRDT, (uint32_t) prdt);
+	outb(bmbase + BM_CMD, BM_CMD_WRITE);
+	outb(bmbase + BM_STATUS, BM_ST_ERR | BM_ST_INTR);	// clear
+
+	ide_command(lba48 ? IDE_CMD_READ_DMA_EXT : IDE_CMD_READ_DMA, sect, n);
+	outb(bmbase + BM_CMD, BM_CMD_WRITE | BM_CMD_START);
+
+	// The drive interrupts once the transfer is done; the bus master
+	// goes inactive when it has filled the PRD table.  Then wait for
+	// the drive to drop BSY before looking at its status.
+	deadline = read_tsc() + DMA_TIMEOUT;
+	while ((inb(bmbase + BM_STATUS) & (BM_ST_INTR|BM_ST_ACTIVE))
+	       == BM_ST_ACTIVE)
+		if (read_tsc() > deadline)
+			goto fail;
+	while (inb(IDE_STATUS) & IDE_BSY)
+		if (read_tsc() > deadline)
+			goto fail;
+	outb(bmbase + BM_CMD, 0);
+
+	if ((inb(bmbase + BM_STATUS) & BM_ST_ERR) || (inb(IDE_STATUS) & IDE_ERR))
+		bad();
+	outb(bmbase + BM_STATUS, BM_ST_ERR | BM_ST_INTR);
+	return n;
+
+fail:
+	ide_dma_fail();
+	return 0;
+}
+
+// Read sectors by PIO, polling the drive once per sector.
+static uint32_t
+ide_read_pio(uint32_t pa, uint32_t sect, uint32_t nsect)
+{
+	uint32_t n;
+
+	ide_command(pio_cmd, sect, nsect);
+	for (n = 0; n < nsect; n++) {
+		waitdisk();
+		insl(IDE_DATA, (void *) pa, SECTSIZE/4);
+		pa += SECTSIZE;
+	}
+	return nsect;
+}
+
+// Read up to 'nsect' sectors starting at 'sect' into physical address
+// 'pa', which must be sector aligned.  Returns the number read.
+static uint32_t
+ide_read(uint32_t pa, uint32_t sect, uint32_t nsect)
+{
+	// a sector count register of 0 means the maximum
+	uint32_t max = lba48 ? 65536 : 256;
+	uint32_t n;
+
+	if (nsect > max)
+		nsect = max;
+	if (bmbase && (n = ide_read_dma(pa, sect, nsect)) > 0)
+		return n;
+	return ide_read_pio(pa, sect, nsect);
+}
@@ -0,0 +1,69 @@
+#ifndef JOS_INC_BOOTINFO_H
+#define JOS_INC_BOOTINFO_H
+
+// The JOS boot loader enters the kernel with JOS_BOOT_MAGIC in %eax
+// and the physical address of a struct Bootinfo in %ebx, much as a
+// Multiboot loader passes its own magic number and info structure.
+// A kernel entered this way may rely on the following:
+//
+//  * Every loadable segment was read only up to p_filesz, and the rest
+//    of p_memsz (including the kernel's BSS) has already been zeroed.
+//
+//  * The Bootinfo fields covered by bi_flags are valid.
+#define JOS_BOOT_MAGIC	0x4A4F5342	// "JOSB" in little endian
+
+// Where the loader builds the Bootinfo (physical address)
+#define BOOTINFO_ADDR	0x1000
+
+// Boot milestones, each timestamped with the TSC as it is reached.
+// The loader records those before BOOT_TS_ENTRY in bi_tsc;
+// the kernel keeps all of them in boot_tsc[] (kern/entry.S).
+#define BOOT_TS_START		0	// boot sector entry (boot/boot.S)
+#define BOOT_TS_BOOTMAIN	1	// boot sector C code (boot/main.c)
+#define BOOT_TS_STAGE2		2	// second stage (boot/stage2.c)
+#define BOOT_TS_LOADED		3	// kernel loaded, about to enter it
+#define BOOT_TS_ENTRY		4	// kernel entry (kern/entry.S)
+#define BOOT_TS_RELOCATED	5	// running at link addresses
+#define BOOT_TS_BSS		6	// BSS cleared (kern/init.c)
+#define BOOT_TS_CONSOLE		7	// console initialized
+#define BOOT_TS_MONITOR		8	// kernel monitor reached
+#define BOOT_NSTAMP		9
+
+// Most memory map entries the loader collects from the BIOS
+#define BI_MAXMMAP		32
+
+// Offsets within struct Bootinfo, for boot/boot.S
+#define BI_NMMAP_OFFSET		4
+#define BI_TSC_OFFSET		8
+#define BI_MMAP_OFFSET		40
+
+// Flag bits for Bootinfo::bi_flags
+#define BI_TSC		0x1	// bi_tsc[] is valid
+#define BI_MMAP		0x2	// bi_mmap[] and bi_nmmap are valid
+
+#ifndef __ASSEMBLER__
+
+// One physical address range, laid out as returned by BIOS E820.
+struct Memrange {
+	uint64_t mr_base;
+	uint64_t mr_len;
+	uint32_t mr_type;
+#define MR_USABLE	1
+#define MR_RESERVED	2
+#define MR_ACPI		3	// ACPI tables, reclaimable
+#define MR_NVS		4	// ACPI non-volatile storage
+#define MR_BAD		5
+	uint32_t mr_attr;	// ACPI 3.0 extended attributes
+#define MR_ATTR_VALID	0x1	// clear: ignore this entry
+};
+
+struct Bootinfo {
+	uint32_t bi_flags;
+	uint32_t bi_nmmap;
+	uint64_t bi_tsc[BOOT_TS_ENTRY];
+	struct Memrange bi_mmap[BI_MAXMMAP];
+};
+
+#endif /* !__ASSEMBLER__ */
+
+#endif /* !JOS_INC_BOOTINFO_H */
@@ -18,6 +18,7 @@
 #define GD_UT     0x18     // user text
 #define GD_UD     0x20     // user data
 #define GD_TSS    0x28     // Task segment selector
+#define GD_CPU    0x30     // per-CPU data (%gs)
 
 /*
  * Virtual memory map:                                Permissions
@@ -36,10 +37,18 @@
  *    KERNBASE ----->  +------------------------------+ 0xf0000000
  *                     |  Cur. Page Table (Kern. RW)  | RW/--  PTSIZE
  *    VPT,KSTACKTOP--> +------------------------------+ 0xefc00000      --+
- *                     |         Kernel Stack         | RW/--  KSTKSIZE   |
+ *                     |     CPU0's Kernel Stack      | RW/--  KSTKSIZE   |
+ *                     | - - - - - - - - - - - - - - -|                   |
+ *                     |      Invalid Memory (*)      | --/--  KSTKGAP    |
+ *                     +------------------------------+                   |
+ *                     |     CPU1's Kernel Stack      | RW/--  KSTKSIZE   |
  *                     | - - - - - - - - - - - - - - -|                 PTSIZE
- *                     |      Invalid Memory (*)      | --/--             |
- *    ULIM     ------> +------------------------------+ 0xef800000      --+
+ *                     |      Invalid Memory (*)      | --/--  KSTKGAP    |
+ *                     +------------------------------+                   |
+ *                     :              .               :                   |
+ *    MMIOLIM ------>  +------------------------------+ 0xef900000        |
+ *                     |       Memory-mapped I/O      | RW/--  PTSIZE/4   |
+ *    ULIM, MMIOBASE ->+------------------------------+ 0xef800000      --+
  *                     |  Cur. Page Table (User R-)   | R-/R-  PTSIZE
  *    UVPT      ---->  +------------------------------+ 0xef400000
  *                     |          RO PAGES            | R-/R-  PTSIZE
@@ -87,6 +96,10 @@
 #define IOPHYSMEM	0x0A0000
 #define EXTPHYSMEM	0x100000
 
+// Physical address at which application processors start, in real
+// mode (see kern/mpentry.S).
+#define MPENTRY_PADDR	0x7000
+
 // Virtual page table.  Entry PDX[VPT] in the PD contains a pointer to
 // the page directory itself, thereby turning the PD into a page table,
 // which maps all the PTEs containing the page mappings for the entire
@@ -94,8 +107,14 @@
 #define VPT		(KERNBASE - PTSIZE)
 #define KSTACKTOP	VPT
 #define KSTKSIZE	(8*PGSIZE)   		// size of a kernel stack
+#define KSTKGAP		(8*PGSIZE)   		// size of a kernel stack guard
 #define ULIM		(KSTACKTOP - PTSIZE) 
 
+// Memory-mapped I/O, such as the local APIC, is mapped at
+// [MMIOBASE, MMIOLIM) by mmio_map_region() in kern/pmap.c.
+#define MMIOBASE	ULIM
+#define MMIOLIM		(MMIOBASE + PTSIZE/4)
+
 /*
  * User read-only mappings! Anything below here til UTOP are readonly to user.
  * They are global pages mapped in at env allocation time.
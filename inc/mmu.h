@@ -65,6 +65,7 @@
 #define PTE_A		0x020	// Accessed
 #define PTE_D		0x040	// Dirty
 #define PTE_PS		0x080	// Page Size
+#define PTE_G		0x100	// Global
 #define PTE_MBZ		0x180	// Bits must be zero
 
 // The PTE_AVAIL bits aren't used by the kernel or interpreted by the
@@ -90,7 +91,10 @@
 #define CR0_CD		0x40000000	// Cache Disable
 #define CR0_PG		0x80000000	// Paging
 
+#define CR4_OSXMMEXCPT	0x00000400	// Unmasked SIMD FP exceptions
+#define CR4_OSFXSR	0x00000200	// FXSAVE/FXRSTOR and SSE enable
 #define CR4_PCE		0x00000100	// Performance counter enable
+#define CR4_PGE		0x00000080	// Page Global Enable
 #define CR4_MCE		0x00000040	// Machine Check Enable
 #define CR4_PSE		0x00000010	// Page Size Extensions
 #define CR4_DE		0x00000008	// Debugging Extensions
@@ -0,0 +1,37 @@
+#ifndef JOS_INC_MULTIBOOT_H
+#define JOS_INC_MULTIBOOT_H
+
+// The parts of the Multiboot 0.6.96 boot information that JOS uses.
+// A Multiboot loader such as GRUB enters the kernel with
+// MULTIBOOT_BOOTLOADER_MAGIC in %eax and the physical address of a
+// struct Multiboot_info in %ebx.
+
+#define MULTIBOOT_BOOTLOADER_MAGIC	0x2BADB002
+
+// Flag bits for Multiboot_info::mb_flags
+#define MB_INFO_MEMORY	0x001	// mb_mem_lower and mb_mem_upper are valid
+#define MB_INFO_MMAP	0x040	// mb_mmap_length and mb_mmap_addr are valid
+
+struct Multiboot_info {
+	uint32_t mb_flags;
+	uint32_t mb_mem_lower;		// KB of memory from 0
+	uint32_t mb_mem_upper;		// KB of memory from 1MB
+	uint32_t mb_boot_device;
+	uint32_t mb_cmdline;
+	uint32_t mb_mods_count;
+	uint32_t mb_mods_addr;
+	uint32_t mb_syms[4];
+	uint32_t mb_mmap_length;	// bytes of memory map
+	uint32_t mb_mmap_addr;		// physical address of memory map
+};
+
+// A memory map entry.  mm_size counts the bytes that follow it,
+// so the next entry is at (char *) &mm_base + mm_size.
+struct Multiboot_mmap {
+	uint32_t mm_size;
+	uint64_t mm_base;
+	uint64_t mm_len;
+	uint32_t mm_type;		// 1 is usable RAM, as for E820
+} __attribute__((packed));
+
+#endif /* !JOS_INC_MULTIBOOT_H */
@@ -10,11 +10,13 @@
 // lib/stdio.c
 void	cputchar(int c);
 int	getchar(void);
+int	getchars(char *buf, int n);
 int	iscons(int fd);
 
 // lib/printfmt.c
 void	printfmt(void (*putch)(int, void*), void *putdat, const char *fmt, ...);
 void	vprintfmt(void (*putch)(int, void*), void *putdat, const char *fmt, va_list);
+void	vspanfmt(void (*putspan)(const char*, int, void*), void *putdat, const char *fmt, va_list);
 int	snprintf(char *str, int size, const char *fmt, ...);
 int	vsnprintf(char *str, int size, const char *fmt, va_list);
 
@@ -10,6 +10,8 @@ static __inline uint16_t inw(int port) __attribute__((always_inline));
 static __inline void insw(int port, void *addr, int cnt) __attribute__((always_inline));
 static __inline uint32_t inl(int port) __attribute__((always_inline));
 static __inline void insl(int port, void *addr, int cnt) __attribute__((always_inline));
+static __inline void stosb(void *addr, int data, int cnt) __attribute__((always_inline));
+static __inline void stosl(void *addr, int data, int cnt) __attribute__((always_inline));
 static __inline void outb(int port, uint8_t data) __attribute__((always_inline));
 static __inline void outsb(int port, const void *addr, int cnt) __attribute__((always_inline));
 static __inline void outw(int port, uint16_t data) __attribute__((always_inline));
@@ -18,6 +20,7 @@ static __inline void outsl(int port, const void *addr, int cnt) __attribute__((a
 static __inline void outl(int port, uint32_t data) __attribute__((always_inline));
 static __inline void invlpg(void *addr) __attribute__((always_inline));
 static __inline void lidt(void *p) __attribute__((always_inline));
+static __inline void lgdt(void *p) __attribute__((always_inline));
 static __inline void lldt(uint16_t sel) __attribute__((always_inline));
 static __inline void ltr(uint16_t sel) __attribute__((always_inline));
 static __inline void lcr0(uint32_t val) __attribute__((always_inline));
@@ -34,6 +37,12 @@ static __inline uint32_t read_ebp(void) __attribute__((always_inline));
 static __inline uint32_t read_esp(void) __attribute__((always_inline));
 static __inline void cpuid(uint32_t info, uint32_t *eaxp, uint32_t *ebxp, uint32_t *ecxp, uint32_t *edxp);
 static __inline uint64_t read_tsc(void) __attribute__((always_inline));
+static __inline uint32_t xchg(volatile uint32_t *addr, uint32_t newval) __attribute__((always_inline));
+static __inline uint32_t cmpxchg(volatile uint32_t *addr, uint32_t oldval, uint32_t newval) __attribute__((always_inline));
+static __inline uint32_t xadd(volatile uint32_t *addr, uint32_t incr) __attribute__((always_inline));
+static __inline void pause(void) __attribute__((always_inline));
+static __inline void cli(void) __attribute__((always_inline));
+static __inline void sti(void) __attribute__((always_inline));
 
 static __inline void
 breakpoint(void)
@@ -92,6 +101,24 @@ insl(int port, void *addr, int cnt)
 			 "memory", "cc");
 }
 
+static __inline void
+stosb(void *addr, int data, int cnt)
+{
+	__asm __volatile("cld\n\trepne\n\tstosb"			:
+			 "=D" (addr), "=c" (cnt)		:
+			 "0" (addr), "1" (cnt), "a" (data)	:
+			 "memory", "cc");
+}
+
+static __inline void
+stosl(void *addr, int data, int cnt)
+{
+	__asm __volatile("cld\n\trepne\n\tstosl"			:
+			 "=D" (addr), "=c" (cnt)		:
+			 "0" (addr), "1" (cnt), "a" (data)	:
+			 "memory", "cc");
+}
+
 static __inline void
 outb(int port, uint8_t data)
 {
@@ -149,6 +176,12 @@ lidt(void *p)
 	__asm __volatile("lidt (%0)" : : "r" (p));
 }
 
+static __inline void
+lgdt(void *p)
+{
+	__asm __volatile("lgdt (%0)" : : "r" (p));
+}
+
 static __inline void
 lldt(uint16_t sel)
 {
@@ -253,9 +286,10 @@ static __inline void
 cpuid(uint32_t info, uint32_t *eaxp, uint32_t *ebxp, uint32_t *ecxp, uint32_t *edxp)
 {
 	uint32_t eax, ebx, ecx, edx;
+	// Leaves with subleaves (e.g., 7) report subleaf 0
 	asm volatile("cpuid" 
 		: "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx)
-		: "a" (info));
+		: "a" (info), "c" (0));
 	if (eaxp)
 		*eaxp = eax;
 	if (ebxp)
@@ -274,4 +308,61 @@ read_tsc(void)
         return tsc;
 }
 
+static __inline uint32_t
+xchg(volatile uint32_t *addr, uint32_t newval)
+{
+	uint32_t result;
+
+	// The + in "+m" denotes a read-modify-write operand.
+	__asm __volatile("lock; xchgl %0, %1" :
+			 "+m" (*addr), "=a" (result) :
+			 "1" (newval) :
+			 "cc");
+	return result;
+}
+
+// Atomically: if *addr == oldval, set *addr = newval.
+// Returns the previous value of *addr either way.
+static __inline uint32_t
+cmpxchg(volatile uint32_t *addr, uint32_t oldval, uint32_t newval)
+{
+	uint32_t result;
+
+	__asm __volatile("lock; cmpxchgl %2, %1" :
+			 "=a" (result), "+m" (*addr) :
+			 "r" (newval), "0" (oldval) :
+			 "cc", "memory");
+	return result;
+}
+
+// Atomically add incr to *addr, returning the previous value.
+static __inline uint32_t
+xadd(volatile uint32_t *addr, uint32_t incr)
+{
+	__asm __volatile("lock; xaddl %0, %1" :
+			 "+r" (incr), "+m" (*addr) : :
+			 "cc", "memory");
+	return incr;
+}
+
+// Spin-wait hint: saves power and avoids a memory-order
+// mis-speculation penalty when the wait ends.
+static __inline void
+pause(void)
+{
+	__asm __volatile("pause" : : : "memory");
+}
+
+static __inline void
+cli(void)
+{
+	__asm __volatile("cli" : : : "memory");
+}
+
+static __inline void
+sti(void)
+{
+	__asm __volatile("sti" : : : "memory");
+}
+
 #endif /* !JOS_INC_X86_H */
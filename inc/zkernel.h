@@ -0,0 +1,30 @@
+#ifndef JOS_INC_ZKERNEL_H
+#define JOS_INC_ZKERNEL_H
+
+// Layout of a compressed kernel image, as built by boot/mkzkernel from
+// the ELF kernel and unpacked by the second-stage boot loader.
+// This header is shared with host tools, so it relies on uint32_t
+// having been defined already rather than including inc/types.h.
+//
+// The image starts with a struct Zkernel.  The LZ4-compressed file
+// contents of each loadable segment follow it, in zk_seg order.
+
+#define ZKERNEL_MAGIC	0x4B5A4F4A	// "JOZK" in little endian
+#define ZK_MAXSEG	8
+
+struct Zksegment {
+	uint32_t zs_va;		// link address of the segment
+	uint32_t zs_filesz;	// bytes of file contents, once inflated
+	uint32_t zs_memsz;	// bytes in memory; the rest are zeroed
+	uint32_t zs_csize;	// bytes of LZ4 block data in the image
+};
+
+struct Zkernel {
+	uint32_t zk_magic;	// must equal ZKERNEL_MAGIC
+	uint32_t zk_entry;	// kernel entry point (link address)
+	uint32_t zk_size;	// size of the whole image, this header included
+	uint32_t zk_nseg;
+	struct Zksegment zk_seg[ZK_MAXSEG];
+};
+
+#endif /* !JOS_INC_ZKERNEL_H */
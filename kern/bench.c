@@ -0,0 +1,258 @@
+// In-kernel microbenchmarks (see kern/bench.h).
+
+#include <inc/types.h>
+#include <inc/stdio.h>
+#include <inc/string.h>
+#include <inc/x86.h>
+#include <inc/mmu.h>
+
+#include <kern/bench.h>
+#include <kern/console.h>
+#include <kern/pmap.h>
+#include <kern/spinlock.h>
+#include <kern/klog.h>
+#include <kern/tsc.h>
+
+struct Bench {
+	const char *name;
+	const char *desc;
+	uint32_t ops;			// operations per sample
+	void (*run)(uint32_t ops);	// perform ops operations
+};
+
+// Buffers for the string and memory benchmarks.  bench_run() fills
+// both pages of bench_src with the same 63-character strings.
+static char bench_src[2 * PGSIZE] __attribute__((aligned(PGSIZE)));
+static char bench_dst[2 * PGSIZE] __attribute__((aligned(PGSIZE)));
+
+// Results land here so that the compiler cannot drop the calls.
+static volatile uint32_t bench_sink;
+
+static void
+bench_memcpy_4k(uint32_t ops)
+{
+	while (ops-- > 0)
+		memcpy(bench_dst, bench_src, PGSIZE);
+}
+
+static void
+bench_memcpy_4k_unaligned(uint32_t ops)
+{
+	while (ops-- > 0)
+		memcpy(bench_dst + 1, bench_src + 3, PGSIZE);
+}
+
+static void
+bench_memcpy_64(uint32_t ops)
+{
+	while (ops-- > 0)
+		memcpy(bench_dst, bench_src, 64);
+}
+
+static void
+bench_memmove_4k(uint32_t ops)
+{
+	// overlapping, so it copies backward
+	while (ops-- > 0)
+		memmove(bench_dst + 64, bench_dst, PGSIZE);
+}
+
+static void
+bench_memset_4k(uint32_t ops)
+{
+	while (ops-- > 0)
+		memset(bench_dst, 0, PGSIZE);
+}
+
+static void
+bench_memcmp_4k(uint32_t ops)
+{
+	while (ops-- > 0)
+		bench_sink = memcmp(bench_src, bench_src + PGSIZE, PGSIZE);
+}
+
+static void
+bench_strlen_64(uint32_t ops)
+{
+	while (ops-- > 0)
+		bench_sink = strlen(bench_src);
+}
+
+static void
+bench_snprintf(uint32_t ops)
+{
+	while (ops-- > 0)
+		bench_sink = snprintf(bench_dst, 64, "%d %s %08x %c",
+				      ops, "bench", ops, 'x');
+}
+
+static void
+bench_cga_line(uint32_t ops)
+{
+	static char blank[80];
+
+	// blank the cursor's row rather than scroll the screen
+	memset(blank, ' ', sizeof(blank));
+	blank[0] = blank[sizeof(blank) - 1] = '\r';
+	while (ops-- > 0)
+		cons_sink_write("cga", blank, sizeof(blank));
+}
+
+static void
+bench_page_alloc(uint32_t ops)
+{
+	struct Page *pp;
+
+	while (ops-- > 0) {
+		if (page_alloc(&pp) < 0)
+			return;
+		page_free(pp);
+	}
+}
+
+static void
+bench_spinlock(uint32_t ops)
+{
+	static struct spinlock lk = SPINLOCK_INITIALIZER(bench);
+
+	while (ops-- > 0) {
+		spin_lock(&lk);
+		spin_unlock(&lk);
+	}
+}
+
+static void
+bench_mcslock(uint32_t ops)
+{
+	static struct mcslock lk = MCSLOCK_INITIALIZER(bench);
+	struct mcsnode me;
+
+	while (ops-- > 0) {
+		mcs_lock(&lk, &me);
+		mcs_unlock(&lk, &me);
+	}
+}
+
+static void
+bench_klog(uint32_t ops)
+{
+	while (ops-- > 0)
+		klog("bench %u %u\n", ops, 0);
+}
+
+static void
+bench_rdtsc(uint32_t ops)
+{
+	while (ops-- > 0)
+		bench_sink = read_tsc();
+}
+
+static struct Bench benches[] = {
+	{ "memcpy-4k", "memcpy one aligned page", 256, bench_memcpy_4k },
+	{ "memcpy-4k-ua", "memcpy one page, misaligned", 256,
+	  bench_memcpy_4k_unaligned },
+	{ "memcpy-64", "memcpy 64 aligned bytes", 4096, bench_memcpy_64 },
+	{ "memmove-4k", "memmove one page backward, overlapping", 256,
+	  bench_memmove_4k },
+	{ "memset-4k", "memset one aligned page", 256, bench_memset_4k },
+	{ "memcmp-4k", "memcmp two equal pages", 256, bench_memcmp_4k },
+	{ "strlen-64", "strlen of a 63-character string", 4096,
+	  bench_strlen_64 },
+	{ "snprintf", "snprintf a short line of four conversions", 1024,
+	  bench_snprintf },
+	{ "cga-line", "write an 80-column line to the CGA sink", 256,
+	  bench_cga_line },
+	{ "page-alloc", "page_alloc and page_free one page", 4096,
+	  bench_page_alloc },
+	{ "spinlock", "uncontended ticket lock and unlock", 4096,
+	  bench_spinlock },
+	{ "mcslock", "uncontended MCS lock and unlock", 4096, bench_mcslock },
+	{ "klog", "klog a record of two words", 4096, bench_klog },
+	{ "rdtsc", "read_tsc", 4096, bench_rdtsc },
+};
+#define NBENCH (sizeof(benches)/sizeof(benches[0]))
+
+void
+bench_list(void)
+{
+	struct Bench *b;
+
+	for (b = benches; b < benches + NBENCH; b++)
+		cprintf("%-14s %s\n", b->name, b->desc);
+}
+
+// Run b and print its statistics.
+static void
+bench_one(struct Bench *b, int nsample, bool raw)
+{
+	uint64_t cyc[BENCH_MAXSAMPLE], t;
+	uint64_t lo, med, hi;
+	uint32_t eflags;
+	int i, j;
+
+	// Let the console finish what it has, so that its interrupts do
+	// not hold off our samples.
+	cons_drain();
+	cons_flush();
+
+	for (i = -BENCH_WARMUP; i < nsample; i++) {
+		eflags = read_eflags();
+		cli();
+		t = read_tsc();
+		b->run(b->ops);
+		t = read_tsc() - t;
+		if (eflags & FL_IF)
+			sti();
+		if (i < 0)
+			continue;
+
+		// insert, in tenths of a cycle per operation, keeping
+		// cyc[0..i] sorted
+		t = t * 10 / b->ops;
+		for (j = i; j > 0 && cyc[j - 1] > t; j--)
+			cyc[j] = cyc[j - 1];
+		cyc[j] = t;
+	}
+
+	lo = cyc[0];
+	med = cyc[nsample / 2];
+	hi = cyc[nsample - 1];
+	if (raw)
+		cprintf("@bench %s %u %d %llu %llu %llu\n", b->name, b->ops,
+			nsample, lo, med, hi);
+	else
+		cprintf("%-14s %8u %8llu.%llu %8llu.%llu %8llu.%llu\n",
+			b->name, b->ops, lo / 10, lo % 10, med / 10, med % 10,
+			hi / 10, hi % 10);
+}
+
+// Run the benchmarks named in names[0..nname-1], where "all" names
+// every benchmark, taking nsample samples of each.
+void
+bench_run(int nname, char **names, int nsample, bool raw)
+{
+	struct Bench *b;
+	int i, found;
+
+	for (i = 0; i < sizeof(bench_src); i++)
+		bench_src[i] = i % 64 == 63 ? '\0' : 'x';
+
+	if (raw)
+		cprintf("@bench khz %u\n", tsc_khz());
+	else
+		cprintf("%-14s %8s %10s %10s %10s  (cycles/op, %d samples)\n",
+			"benchmark", "ops", "min", "median", "max", nsample);
+	for (i = 0; i < nname; i++) {
+		found = 0;
+		for (b = benches; b < benches + NBENCH; b++)
+			if (strcmp(names[i], "all") == 0
+			    || strcmp(names[i], b->name) == 0) {
+				bench_one(b, nsample, raw);
+				found = 1;
+			}
+		if (!found)
+			cprintf("bench: no benchmark '%s'\n", names[i]);
+	}
+	if (raw)
+		cprintf("@bench end\n");
+}
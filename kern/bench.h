@@ -0,0 +1,32 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_BENCH_H
+#define JOS_KERN_BENCH_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+
+// In-kernel microbenchmarks.
+//
+// Each benchmark times one kernel primitive in place.  A sample runs
+// the operation a fixed number of times back to back, with interrupts
+// off; after BENCH_WARMUP samples that are thrown away, bench_run()
+// reports cycles per operation over nsample samples as min, median
+// and max.  In raw mode it prints instead, for scripts reading the
+// serial console,
+//	@bench khz <TSC kHz>
+//	@bench <name> <ops per sample> <samples> <min> <median> <max>
+//	@bench end
+// with the cycle counts in tenths of a cycle per operation.  bench.sh
+// runs these under QEMU and compares them against a baseline.
+
+#define BENCH_WARMUP	2
+#define BENCH_NSAMPLE	11	// default samples per benchmark
+#define BENCH_MAXSAMPLE	101
+
+void bench_list(void);
+void bench_run(int nname, char **names, int nsample, bool raw);
+
+#endif	// !JOS_KERN_BENCH_H
@@ -5,11 +5,15 @@
 #include <inc/kbdreg.h>
 #include <inc/string.h>
 #include <inc/assert.h>
+#include <inc/trap.h>
+#include <inc/error.h>
 
 #include <kern/console.h>
+#include <kern/picirq.h>
+#include <kern/spinlock.h>
+#include <kern/cpu.h>
 
 static void cons_intr(int (*proc)(void));
-static void cons_putc(int c);
 
 // Stupid I/O delay routine necessitated by historical PC design flaws
 static void
@@ -21,6 +25,89 @@ delay(void)
 	inb(0x84);
 }
 
+/***** Output queues *****/
+
+// A queue lets a console device take output at its own pace.
+// Writers append to it, and the device's pump function moves bytes
+// out as fast as the hardware accepts them, never waiting.
+#define OUTQ_SIZE	4096	// must be a power of 2
+
+struct outq {
+	struct spinlock lock;
+	uint32_t rpos;		// free-running
+	uint32_t wpos;
+	uint32_t dropped;	// bytes lost to a full queue
+	char buf[OUTQ_SIZE];
+};
+
+#define OUTQ_INITIALIZER(nam)	{ SPINLOCK_INITIALIZER(nam) }
+
+// Return the next queued byte, or -1 if the queue is empty.
+// Called with q->lock held.
+static int
+outq_getc(struct outq *q)
+{
+	if (q->rpos == q->wpos)
+		return -1;
+	return (unsigned char) q->buf[q->rpos++ & (OUTQ_SIZE - 1)];
+}
+
+// Queue n bytes, then pump.  When the queue is full, pump() is
+// polled for room for a while if 'wait' is set; failing that, the
+// oldest byte is dropped.
+static void
+outq_write(struct outq *q, void (*pump)(void), bool wait,
+	   const char *s, size_t n)
+{
+	uint32_t eflags;
+	int i;
+
+	eflags = spin_lock_irqsave(&q->lock);
+	for (; n > 0; n--) {
+		for (i = 0; q->wpos - q->rpos == OUTQ_SIZE; i++) {
+			pump();
+			if (!wait || i == 12800)
+				break;
+			delay();
+		}
+		if (q->wpos - q->rpos == OUTQ_SIZE) {
+			q->rpos++;
+			q->dropped++;
+		}
+		q->buf[q->wpos++ & (OUTQ_SIZE - 1)] = *s++;
+	}
+	pump();
+	spin_unlock_irqrestore(&q->lock, eflags);
+}
+
+// Pump the queue, without waiting for the device.
+static void
+outq_poll(struct outq *q, void (*pump)(void))
+{
+	uint32_t eflags;
+
+	eflags = spin_lock_irqsave(&q->lock);
+	pump();
+	spin_unlock_irqrestore(&q->lock, eflags);
+}
+
+// Pump the queue until the device has taken everything, or seems stuck.
+static void
+outq_flush(struct outq *q, void (*pump)(void))
+{
+	uint32_t eflags;
+	int i;
+
+	eflags = spin_lock_irqsave(&q->lock);
+	for (i = 0; q->rpos != q->wpos && i < 12800; i++) {
+		pump();
+		delay();
+	}
+	spin_unlock_irqrestore(&q->lock, eflags);
+}
+
+
+
 /***** Serial I/O code *****/
 
 #define COM1		0x3F8
@@ -31,8 +118,13 @@ delay(void)
 #define COM_DLM		1	// Out: Divisor Latch High (DLAB=1)
 #define COM_IER		1	// Out: Interrupt Enable Register
 #define   COM_IER_RDI	0x01	//   Enable receiver data interrupt
+#define   COM_IER_TXI	0x02	//   Enable transmitter empty interrupt
 #define COM_IIR		2	// In:	Interrupt ID Register
+#define   COM_IIR_FIFO	0xC0	//   FIFOs enabled (16550A)
 #define COM_FCR		2	// Out: FIFO Control Register
+#define   COM_FCR_ENABLE 0x01	//   Enable the FIFOs
+#define   COM_FCR_RCLR	0x02	//   Clear the receive FIFO
+#define   COM_FCR_TCLR	0x04	//   Clear the transmit FIFO
 #define COM_LCR		3	// Out: Line Control Register
 #define	  COM_LCR_DLAB	0x80	//   Divisor latch access bit
 #define	  COM_LCR_WLEN8	0x03	//   Wordlength: 8 bits
@@ -45,7 +137,21 @@ delay(void)
 #define   COM_LSR_TXRDY	0x20	//   Transmit buffer avail
 #define   COM_LSR_TSRE	0x40	//   Transmitter off
 
+#define COM_FIFOSIZE	16	// 16550A transmit FIFO depth
+
+// Line speed, overridden from the make command line (SERIAL_BAUD=...)
+#ifndef SERIAL_BAUD
+#define SERIAL_BAUD	9600
+#endif
+
 static bool serial_exists;
+static int serial_fifosize;	// bytes the transmitter takes at once
+static uint8_t serial_ier;	// current COM_IER value
+
+// Serial output waits in this queue.  The transmitter-empty interrupt
+// moves it into the UART a FIFO-full at a time; when interrupts are
+// off, serial_intr() polls and does the same.
+static struct outq serial_q = OUTQ_INITIALIZER(serial_q);
 
 static int
 serial_proc_data(void)
@@ -55,51 +161,82 @@ serial_proc_data(void)
 	return inb(COM1+COM_RX);
 }
 
+// If the transmitter is empty, refill it from the queue, and ask for
+// an interrupt when it empties again only if more remains queued.
+// Called with serial_q.lock held.
+static void
+serial_txfill(void)
+{
+	uint8_t ier;
+	int n, c;
+
+	if (inb(COM1+COM_LSR) & COM_LSR_TXRDY)
+		for (n = 0; n < serial_fifosize
+			     && (c = outq_getc(&serial_q)) != -1; n++)
+			outb(COM1+COM_TX, c);
+
+	ier = COM_IER_RDI;
+	if (serial_q.rpos != serial_q.wpos)
+		ier |= COM_IER_TXI;
+	if (ier != serial_ier)
+		outb(COM1+COM_IER, serial_ier = ier);
+}
+
+// Called for the serial IRQ, and polled by cons_getc.
 void
 serial_intr(void)
 {
-	if (serial_exists)
-		cons_intr(serial_proc_data);
+	if (!serial_exists)
+		return;
+	cons_intr(serial_proc_data);
+	outq_poll(&serial_q, serial_txfill);
 }
 
+// Serial is the console of record, so a full queue waits for the
+// line rather than dropping output.
 static void
-serial_putc(int c)
+serial_write(const char *s, size_t n)
 {
-	int i;
-	
-	for (i = 0;
-	     !(inb(COM1 + COM_LSR) & COM_LSR_TXRDY) && i < 12800;
-	     i++)
-		delay();
-	
-	outb(COM1 + COM_TX, c);
+	outq_write(&serial_q, serial_txfill, 1, s, n);
+}
+
+static void
+serial_flush(void)
+{
+	outq_flush(&serial_q, serial_txfill);
 }
 
 static void
 serial_init(void)
 {
-	// Turn off the FIFO
-	outb(COM1+COM_FCR, 0);
+	// Turn on and clear the FIFOs, if it has them
+	outb(COM1+COM_FCR, COM_FCR_ENABLE | COM_FCR_RCLR | COM_FCR_TCLR);
 	
 	// Set speed; requires DLAB latch
 	outb(COM1+COM_LCR, COM_LCR_DLAB);
-	outb(COM1+COM_DLL, (uint8_t) (115200 / 9600));
-	outb(COM1+COM_DLM, 0);
+	outb(COM1+COM_DLL, (uint8_t) (115200 / SERIAL_BAUD));
+	outb(COM1+COM_DLM, (uint8_t) ((115200 / SERIAL_BAUD) >> 8));
 
 	// 8 data bits, 1 stop bit, parity off; turn off DLAB latch
 	outb(COM1+COM_LCR, COM_LCR_WLEN8 & ~COM_LCR_DLAB);
 
-	// No modem controls
-	outb(COM1+COM_MCR, 0);
-	// Enable rcv interrupts
-	outb(COM1+COM_IER, COM_IER_RDI);
+	// No modem controls, but OUT2 gates the UART's IRQ line
+	outb(COM1+COM_MCR, COM_MCR_OUT2);
+	// Enable rcv interrupts; transmit interrupts are enabled
+	// while there is output queued
+	serial_ier = COM_IER_RDI;
+	outb(COM1+COM_IER, serial_ier);
 
 	// Clear any preexisting overrun indications and interrupts
 	// Serial port doesn't exist if COM_LSR returns 0xFF
 	serial_exists = (inb(COM1+COM_LSR) != 0xFF);
-	(void) inb(COM1+COM_IIR);
+	serial_fifosize = (inb(COM1+COM_IIR) & COM_IIR_FIFO) == COM_IIR_FIFO
+		? COM_FIFOSIZE : 1;
 	(void) inb(COM1+COM_RX);
 
+	if (serial_exists)
+		irq_setmask_8259A(irq_mask_8259A & ~(1<<IRQ_SERIAL));
+
 }
 
 
@@ -108,16 +245,62 @@ serial_init(void)
 // For information on PC parallel port programming, see the class References
 // page.
 
+#define LPT1		0x378
+
+#define LPT_DATA	0	// Out: Data
+#define LPT_STATUS	1	// In:	Status
+#define   LPT_STATUS_NBUSY 0x80	//   Printer ready for data
+#define LPT_CONTROL	2	// Out: Control
+#define   LPT_CTL_STROBE 0x01	//   Data is valid
+#define   LPT_CTL_INIT	0x04	//   Don't reset the printer
+#define   LPT_CTL_SELECT 0x08	//   Select the printer
+
+static bool lpt_exists;
+
+// Printer output waits here, so that a slow or missing printer never
+// holds up the other devices.
+static struct outq lpt_q = OUTQ_INITIALIZER(lpt_q);
+
+// Hand the printer queued bytes for as long as it is ready for them.
+// Called with lpt_q.lock held.
 static void
-lpt_putc(int c)
+lpt_pump(void)
 {
-	int i;
+	int c;
 
-	for (i = 0; !(inb(0x378+1) & 0x80) && i < 12800; i++)
-		delay();
-	outb(0x378+0, c);
-	outb(0x378+2, 0x08|0x04|0x01);
-	outb(0x378+2, 0x08);
+	while ((inb(LPT1+LPT_STATUS) & LPT_STATUS_NBUSY)
+	       && (c = outq_getc(&lpt_q)) != -1) {
+		outb(LPT1+LPT_DATA, c);
+		outb(LPT1+LPT_CONTROL, LPT_CTL_SELECT|LPT_CTL_INIT|LPT_CTL_STROBE);
+		outb(LPT1+LPT_CONTROL, LPT_CTL_SELECT);
+	}
+}
+
+static void
+lpt_write(const char *s, size_t n)
+{
+	outq_write(&lpt_q, lpt_pump, 0, s, n);
+}
+
+static void
+lpt_flush(void)
+{
+	outq_flush(&lpt_q, lpt_pump);
+}
+
+// Polled by cons_getc, there being no printer interrupt.
+static void
+lpt_intr(void)
+{
+	if (lpt_exists)
+		outq_poll(&lpt_q, lpt_pump);
+}
+
+static void
+lpt_init(void)
+{
+	// No port answers with all status bits set.
+	lpt_exists = (inb(LPT1+LPT_STATUS) != 0xFF);
 }
 
 
@@ -125,9 +308,28 @@ lpt_putc(int c)
 
 /***** Text-mode CGA/VGA display output *****/
 
+// The screen is a window of CRT_ROWS rows onto video memory, which
+// holds crt_nrows rows.  Scrolling moves the window down a row by
+// reprogramming the 6845's start address; only when the window
+// reaches the end of video memory is the screen copied back to the
+// start.  (Monochrome adapters have room for just one screen, so
+// there every scroll is a copy.)
+//
+// The cursor and start address registers are written only when
+// cga_flush() is called, once per run of output.
+//
+// cga_lock covers the crt_* state, video memory and the 6845 index
+// and data ports.  The draining CPU and a CPU in cputchar() may both
+// write to the screen at once.
+
 static unsigned addr_6845;
 static uint16_t *crt_buf;
-static uint16_t crt_pos;
+static uint16_t crt_pos;	// cursor, as a cell index into crt_buf
+static uint16_t crt_top;	// first cell on the screen
+static uint16_t crt_nrows;	// rows of video memory
+static uint16_t crt_shown_pos;	// as last written to the 6845
+static uint16_t crt_shown_top;
+static struct spinlock cga_lock = SPINLOCK_INITIALIZER(cga_lock);
 
 static void
 cga_init(void)
@@ -142,9 +344,11 @@ cga_init(void)
 	if (*cp != 0xA55A) {
 		cp = (uint16_t*) (KERNBASE + MONO_BUF);
 		addr_6845 = MONO_BASE;
+		crt_nrows = CRT_ROWS;
 	} else {
 		*cp = was;
 		addr_6845 = CGA_BASE;
+		crt_nrows = CGA_BUFSIZE / (CRT_COLS * sizeof(uint16_t));
 	}
 	
 	/* Extract cursor location */
@@ -154,13 +358,61 @@ cga_init(void)
 	pos |= inb(addr_6845 + 1);
 
 	crt_buf = (uint16_t*) cp;
-	crt_pos = pos;
+	crt_pos = crt_shown_pos = pos;
+
+	// Start with the window at the beginning of video memory.
+	crt_top = crt_shown_top = 0;
+	outb(addr_6845, 12);
+	outb(addr_6845 + 1, 0);
+	outb(addr_6845, 13);
+	outb(addr_6845 + 1, 0);
+}
+
+
+
+/* move that little blinky thing, and the window */
+static void
+cga_flush(void)
+{
+	if (crt_top != crt_shown_top) {
+		outb(addr_6845, 12);
+		outb(addr_6845 + 1, crt_top >> 8);
+		outb(addr_6845, 13);
+		outb(addr_6845 + 1, crt_top);
+		crt_shown_top = crt_top;
+	}
+	if (crt_pos != crt_shown_pos) {
+		outb(addr_6845, 14);
+		outb(addr_6845 + 1, crt_pos >> 8);
+		outb(addr_6845, 15);
+		outb(addr_6845 + 1, crt_pos);
+		crt_shown_pos = crt_pos;
+	}
 }
 
+// Move the window down a row, and blank the row that comes into view.
+static void
+cga_scroll(void)
+{
+	int i;
 
+	if (crt_top + CRT_SIZE + CRT_COLS <= crt_nrows * CRT_COLS)
+		crt_top += CRT_COLS;
+	else {
+		// No room below: copy the rows that stay on the screen
+		// back to the start of video memory.
+		memmove(crt_buf, crt_buf + crt_top + CRT_COLS,
+			(CRT_SIZE - CRT_COLS) * sizeof(uint16_t));
+		crt_pos -= crt_top + CRT_COLS;
+		crt_top = 0;
+	}
+	for (i = crt_top + CRT_SIZE - CRT_COLS; i < crt_top + CRT_SIZE; i++)
+		crt_buf[i] = 0x0700 | ' ';
+}
 
+// Put c on the screen without moving the cursor.
 static void
-cga_putc(int c)
+cga_emit(int c)
 {
 	// if no attribute given, then use black on white
 	if (!(c & ~0xFF))
@@ -168,7 +420,7 @@ cga_putc(int c)
 
 	switch (c & 0xff) {
 	case '\b':
-		if (crt_pos > 0) {
+		if (crt_pos > crt_top) {
 			crt_pos--;
 			crt_buf[crt_pos] = (c & ~0xff) | ' ';
 		}
@@ -180,32 +432,33 @@ cga_putc(int c)
 		crt_pos -= (crt_pos % CRT_COLS);
 		break;
 	case '\t':
-		cons_putc(' ');
-		cons_putc(' ');
-		cons_putc(' ');
-		cons_putc(' ');
-		cons_putc(' ');
+		cga_emit(' ');
+		cga_emit(' ');
+		cga_emit(' ');
+		cga_emit(' ');
+		cga_emit(' ');
 		break;
 	default:
 		crt_buf[crt_pos++] = c;		/* write the character */
 		break;
 	}
 
-	// What is the purpose of this?
-	if (crt_pos >= CRT_SIZE) {
-		int i;
+	if (crt_pos >= crt_top + CRT_SIZE)
+		cga_scroll();
+}
 
-		memmove(crt_buf, crt_buf + CRT_COLS, (CRT_SIZE - CRT_COLS) * sizeof(uint16_t));
-		for (i = CRT_SIZE - CRT_COLS; i < CRT_SIZE; i++)
-			crt_buf[i] = 0x0700 | ' ';
-		crt_pos -= CRT_COLS;
-	}
+// Put a run of characters on the screen, updating the 6845 (slow
+// port writes) only once at the end.
+static void
+cga_write(const char *s, size_t n)
+{
+	uint32_t eflags;
 
-	/* move that little blinky thing */
-	outb(addr_6845, 14);
-	outb(addr_6845 + 1, crt_pos >> 8);
-	outb(addr_6845, 15);
-	outb(addr_6845 + 1, crt_pos);
+	eflags = spin_lock_irqsave(&cga_lock);
+	for (; n > 0; n--)
+		cga_emit(*(const unsigned char *) s++);
+	cga_flush();
+	spin_unlock_irqrestore(&cga_lock, eflags);
 }
 
 
@@ -353,6 +606,7 @@ kbd_proc_data(void)
 	// Process special keys
 	// Ctrl-Alt-Del: reboot
 	if (!(~shift & (CTL | ALT)) && c == KEY_DEL) {
+		cons_sync();
 		cprintf("Rebooting!\n");
 		outb(0x92, 0x3); // courtesy of Chris Frost
 	}
@@ -369,6 +623,10 @@ kbd_intr(void)
 static void
 kbd_init(void)
 {
+	// Drain the kbd buffer so that the 8042 raises IRQ 1 for the
+	// next key, then enable it.
+	kbd_intr();
+	irq_setmask_8259A(irq_mask_8259A & ~(1<<IRQ_KBD));
 }
 
 
@@ -377,15 +635,40 @@ kbd_init(void)
 // Here we manage the console input buffer,
 // where we stash characters received from the keyboard or serial port
 // whenever the corresponding interrupt occurs.
-
-#define CONSBUFSIZE 512
+//
+// Interrupt handlers on any CPU may add characters at once, so the
+// buffer is a lock-free ring with many producers and one consumer.
+// A producer claims a slot by advancing wpos with cmpxchg, then
+// stores its character, flagged CONS_FULL, into the slot; that store
+// publishes it.  The consumer takes characters in order for as long
+// as their slots are full, clearing each slot before advancing rpos
+// past it.
+
+#define CONSBUFSIZE	512	// must be a power of 2
+#define CONS_FULL	0x100	// slot holds an unread character
 
 static struct {
-	uint8_t buf[CONSBUFSIZE];
-	uint32_t rpos;
-	uint32_t wpos;
+	volatile uint32_t wpos;		// next slot to claim
+	volatile uint32_t rpos;		// next slot to read
+	volatile uint32_t dropped;	// characters lost to a full buffer
+	volatile uint16_t slot[CONSBUFSIZE];
 } cons;
 
+static void
+cons_put(int c)
+{
+	uint32_t w;
+
+	do {
+		w = cons.wpos;
+		if (w - cons.rpos >= CONSBUFSIZE) {
+			xadd(&cons.dropped, 1);
+			return;
+		}
+	} while (cmpxchg(&cons.wpos, w, w + 1) != w);
+	cons.slot[w & (CONSBUFSIZE - 1)] = (c & 0xFF) | CONS_FULL;
+}
+
 // called by device interrupt routines to feed input characters
 // into the circular console input buffer.
 static void
@@ -393,77 +676,275 @@ cons_intr(int (*proc)(void))
 {
 	int c;
 
-	while ((c = (*proc)()) != -1) {
-		if (c == 0)
-			continue;
-		cons.buf[cons.wpos++] = c;
-		if (cons.wpos == CONSBUFSIZE)
-			cons.wpos = 0;
+	while ((c = (*proc)()) != -1)
+		if (c != 0)
+			cons_put(c);
+}
+
+// Is there input waiting to be read?
+static bool
+cons_pending(void)
+{
+	return (cons.slot[cons.rpos & (CONSBUFSIZE - 1)] & CONS_FULL) != 0;
+}
+
+// Take up to n characters from the input buffer into buf, without
+// waiting.  Returns the number taken.  Only one CPU at a time may read.
+int
+cons_read(char *buf, int n)
+{
+	uint32_t r = cons.rpos;
+	uint16_t v;
+	int i;
+
+	for (i = 0; i < n; i++, r++) {
+		v = cons.slot[r & (CONSBUFSIZE - 1)];
+		if (!(v & CONS_FULL))
+			break;	// empty, or claimed but not yet stored
+		buf[i] = v;
+		cons.slot[r & (CONSBUFSIZE - 1)] = 0;
 	}
+	// The cleared slots must be seen before their reuse is allowed.
+	__asm __volatile("" : : : "memory");
+	cons.rpos = r;
+	return i;
+}
+
+// Poll the input devices, so that input arrives even when interrupts
+// are disabled (e.g., when the kernel monitor runs after a panic),
+// and write out pending output while we are at it.
+static void
+cons_poll(void)
+{
+	uint32_t eflags;
+
+	// a CPU waiting for input has time to write out pending output
+	cons_drain();
+
+	// The device interrupts on this CPU read the same device
+	// registers, so keep them out while we do.
+	eflags = read_eflags();
+	cli();
+	serial_intr();
+	kbd_intr();
+	lpt_intr();
+	if (eflags & FL_IF)
+		sti();
 }
 
 // return the next input character from the console, or 0 if none waiting
 int
 cons_getc(void)
 {
-	int c;
+	char c;
 
-	// poll for any pending input characters,
-	// so that this function works even when interrupts are disabled
-	// (e.g., when called from the kernel monitor).
-	serial_intr();
-	kbd_intr();
+	cons_poll();
+	if (cons_read(&c, 1) == 0)
+		return 0;
+	return (unsigned char) c;
+}
+
+/***** Console output devices *****/
+
+// Console output goes to each sink that is both present and enabled.
+// Sinks with a queue take output at their own pace, so none of them
+// holds back the others.
+struct Conssink {
+	const char *name;
+	void (*write)(const char *s, size_t n);
+	void (*flush)(void);	// wait for queued output, or NULL
+	struct outq *q;		// NULL if output is taken at once
+	bool *exists;
+	bool enabled;
+};
+
+static bool cga_exists = 1;
 
-	// grab the next character from the input buffer.
-	if (cons.rpos != cons.wpos) {
-		c = cons.buf[cons.rpos++];
-		if (cons.rpos == CONSBUFSIZE)
-			cons.rpos = 0;
-		return c;
+static struct Conssink sinks[] = {
+	{ "serial", serial_write, serial_flush, &serial_q, &serial_exists },
+	{ "lpt", lpt_write, lpt_flush, &lpt_q, &lpt_exists },
+	{ "cga", cga_write, NULL, NULL, &cga_exists },
+};
+#define NSINKS (sizeof(sinks)/sizeof(sinks[0]))
+
+// Sinks enabled at boot: a comma-separated list of sink names,
+// overridden from the make command line (CONS_SINKS=...)
+#ifndef CONS_SINKS
+#define CONS_SINKS	"serial,lpt,cga"
+#endif
+
+// output a character to the console devices
+void
+cons_putc(int c)
+{
+	char ch = c;
+
+	cons_write(&ch, 1);
+}
+
+// output a run of characters to the console devices;
+// each device gets the whole run at once
+void
+cons_write(const char *s, size_t n)
+{
+	struct Conssink *k;
+
+	for (k = sinks; k < sinks + NSINKS; k++)
+		if (k->enabled && *k->exists)
+			k->write(s, n);
+}
+
+// wait until the console devices have taken all output written so far
+void
+cons_flush(void)
+{
+	struct Conssink *k;
+
+	for (k = sinks; k < sinks + NSINKS; k++)
+		if (k->enabled && *k->exists && k->flush)
+			k->flush();
+}
+
+// Write to the named sink alone, enabled or not, if it is present.
+// Returns 0 on success, or -E_INVAL if there is no such sink.
+int
+cons_sink_write(const char *name, const char *s, size_t n)
+{
+	struct Conssink *k;
+
+	for (k = sinks; k < sinks + NSINKS; k++)
+		if (strcmp(k->name, name) == 0) {
+			if (*k->exists)
+				k->write(s, n);
+			return 0;
+		}
+	return -E_INVAL;
+}
+
+// Enable or disable the named sink.
+// Returns 0 on success, or -E_INVAL if there is no such sink.
+int
+cons_sink_enable(const char *name, bool on)
+{
+	struct Conssink *k;
+
+	for (k = sinks; k < sinks + NSINKS; k++)
+		if (strcmp(k->name, name) == 0) {
+			if (!on && k->flush)
+				k->flush();
+			k->enabled = on;
+			return 0;
+		}
+	return -E_INVAL;
+}
+
+void
+cons_sink_print(void)
+{
+	struct Conssink *k;
+
+	for (k = sinks; k < sinks + NSINKS; k++) {
+		cprintf("%-8s %s%s", k->name, k->enabled ? "on" : "off",
+			*k->exists ? "" : " (not present)");
+		if (k->q)
+			cprintf(", %u bytes queued, %u dropped",
+				k->q->wpos - k->q->rpos, k->q->dropped);
+		cprintf("\n");
 	}
-	return 0;
+	cprintf("input: %u characters dropped\n", cons.dropped);
 }
 
-// output a character to the console
-static void
-cons_putc(int c)
+// Is 'name' in the comma-separated 'list'?
+static bool
+inlist(const char *list, const char *name)
 {
-	serial_putc(c);
-	lpt_putc(c);
-	cga_putc(c);
+	int n = strlen(name);
+
+	while (*list) {
+		if (strncmp(list, name, n) == 0
+		    && (list[n] == ',' || list[n] == '\0'))
+			return 1;
+		if ((list = strchr(list, ',')) == NULL)
+			break;
+		list++;
+	}
+	return 0;
 }
 
 // initialize the console devices
 void
 cons_init(void)
 {
+	struct Conssink *k;
+
 	cga_init();
 	kbd_init();
 	serial_init();
+	lpt_init();
+
+	for (k = sinks; k < sinks + NSINKS; k++)
+		k->enabled = inlist(CONS_SINKS, k->name);
 
 	if (!serial_exists)
 		cprintf("Serial port does not exist!\n");
+	cons_startasync();
 }
 
 
-// `High'-level console I/O.  Used by readline and cprintf.
+// `High'-level console I/O.  Used by readline.
 
 void
 cputchar(int c)
 {
+	// keep echoed input behind any cprintf output still buffered
+	cons_drain();
 	cons_putc(c);
 }
 
+// Wait for console input to arrive.  The keyboard and serial
+// interrupts come to the boot CPU, so if that is us and interrupts
+// are on, halt until the next interrupt; otherwise, spin politely.
+static void
+cons_wait(void)
+{
+	if (thiscpu != bootcpu || !(read_eflags() & FL_IF)
+	    || lpt_q.rpos != lpt_q.wpos) {	// the printer is polled
+		pause();
+		return;
+	}
+	// Check for input with interrupts off, then enable them and
+	// halt in one step, so an interrupt cannot slip in between.
+	cli();
+	if (!cons_pending())
+		__asm __volatile("sti; hlt");
+	else
+		sti();
+}
+
 int
 getchar(void)
 {
 	int c;
 
 	while ((c = cons_getc()) == 0)
-		/* do nothing */;
+		cons_wait();
 	return c;
 }
 
+// Wait for input, then return everything pending, up to n characters.
+int
+getchars(char *buf, int n)
+{
+	int r;
+
+	while (1) {
+		cons_poll();
+		if ((r = cons_read(buf, n)) > 0)
+			return r;
+		cons_wait();
+	}
+}
+
 int
 iscons(int fdnum)
 {
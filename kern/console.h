@@ -12,6 +12,7 @@
 #define MONO_BUF	0xB0000
 #define CGA_BASE	0x3D4
 #define CGA_BUF		0xB8000
+#define CGA_BUFSIZE	0x8000	// bytes of CGA video memory
 
 #define CRT_ROWS	25
 #define CRT_COLS	80
@@ -19,6 +20,18 @@
 
 void cons_init(void);
 int cons_getc(void);
+int cons_read(char *buf, int n);
+void cons_putc(int c);
+void cons_write(const char *s, size_t n);
+void cons_flush(void);
+int cons_sink_enable(const char *name, bool on);
+int cons_sink_write(const char *name, const char *s, size_t n);
+void cons_sink_print(void);
+
+// Buffered cprintf output (kern/printf.c)
+void cons_startasync(void);
+void cons_drain(void);
+void cons_sync(void);
 
 void kbd_intr(void); // irq 1
 void serial_intr(void); // irq 4
@@ -0,0 +1,109 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_CPU_H
+#define JOS_KERN_CPU_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+#include <inc/memlayout.h>
+#include <inc/mmu.h>
+
+// Maximum number of CPUs
+#define NCPU		8
+
+// Entries in each CPU's GDT: null, GD_KT, GD_KD, GD_UT, GD_UD, GD_TSS,
+// GD_CPU
+#define NGDT		7
+
+// Size of a cache line, to keep CPUs' data from sharing one
+#define CACHELINE	64
+
+// Values of status in struct CpuInfo
+enum {
+	CPU_UNUSED = 0,
+	CPU_STARTED,
+	CPU_HALTED,
+};
+
+// Per-CPU event counters, indexing cpu_counter[]
+enum {
+	PCPU_SCHED_CALLS = 0,           // Functions run by sched_idle()
+	PCPU_NCOUNTER
+};
+
+// Bytes of per-CPU scratch space
+#define PCPU_SCRATCH	256
+
+struct Env;
+
+// Per-CPU state.  Each CPU's %gs selects a GD_CPU segment based at
+// its own entry in cpus[], so its fields are one %gs-relative
+// instruction away (see percpu_get() below).
+struct CpuInfo {
+	struct CpuInfo *cpu_self;       // &cpus[cpu_id], for thiscpu
+	uint8_t cpu_id;                 // Index into cpus[] below
+	uint8_t cpu_apicid;             // Local APIC ID
+	volatile unsigned cpu_status;   // The status of the CPU
+	struct Env *cpu_env;            // The currently-running environment
+	struct Segdesc cpu_gdt[NGDT];   // This CPU's GDT
+	struct Taskstate cpu_ts;        // Used by x86 to find stack for interrupt
+
+	// Work handed to this CPU's idle loop by sched_call()
+	void (*volatile cpu_fn)(void *);
+	void *volatile cpu_arg;
+
+	uint32_t cpu_counter[PCPU_NCOUNTER];
+	char cpu_scratch[PCPU_SCRATCH];
+} __attribute__((aligned(CACHELINE)));
+
+// Read or write a field (of at most 4 bytes) of this CPU's CpuInfo.
+#define percpu_get(field)						\
+({									\
+	typeof(((struct CpuInfo *) 0)->field) __v;			\
+	__asm __volatile("mov %%gs:%c1, %0" : "=q" (__v)		\
+			 : "i" (offsetof(struct CpuInfo, field)));	\
+	__v;								\
+})
+#define percpu_set(field, v)						\
+	__asm __volatile("mov %1, %%gs:%c0"				\
+			 : : "i" (offsetof(struct CpuInfo, field)),	\
+			 "q" ((typeof(((struct CpuInfo *) 0)->field)) (v)) \
+			 : "memory")
+
+// Bump one of this CPU's counters.  A single instruction, so it is
+// safe against interrupts on this CPU without a lock prefix.
+#define percpu_inc(counter)						\
+	__asm __volatile("incl %%gs:%c0"				\
+			 : : "i" (offsetof(struct CpuInfo, cpu_counter[counter])) \
+			 : "cc", "memory")
+#define percpu_add(counter, n)						\
+	__asm __volatile("addl %1, %%gs:%c0"				\
+			 : : "i" (offsetof(struct CpuInfo, cpu_counter[counter])), \
+			 "ri" ((uint32_t) (n)) : "cc", "memory")
+
+#define thiscpu		percpu_get(cpu_self)
+#define cpunum()	percpu_get(cpu_id)
+#define curenv		percpu_get(cpu_env)
+#define percpu_scratch() (thiscpu->cpu_scratch)
+
+// Initialized in mpconfig.c
+extern struct CpuInfo cpus[NCPU];
+extern int ncpu;                    // Total number of CPUs in the system
+extern struct CpuInfo *bootcpu;     // The boot-strap processor (BSP)
+extern int ismp;                    // Found ACPI or MP tables?
+extern uint8_t cpu_by_apicid[256];  // Index into cpus[] by local APIC ID
+extern physaddr_t lapicaddr;        // Physical MMIO address of the local APIC
+
+// Per-CPU kernel stacks, mapped at KSTACKTOP - i * (KSTKSIZE + KSTKGAP)
+extern unsigned char percpu_kstacks[NCPU][KSTKSIZE];
+
+int cpu_identify(void);
+void mp_init(void);
+void lapic_init(void);
+void lapic_startap(uint8_t apicid, uint32_t addr);
+void lapic_eoi(void);
+void lapic_ipi(int vector);
+
+#endif
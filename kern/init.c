@@ -3,9 +3,20 @@
 #include <inc/stdio.h>
 #include <inc/string.h>
 #include <inc/assert.h>
+#include <inc/bootinfo.h>
+#include <inc/memlayout.h>
 
 #include <kern/monitor.h>
 #include <kern/console.h>
+#include <kern/tsc.h>
+#include <kern/pmap.h>
+#include <kern/cpu.h>
+#include <kern/trap.h>
+#include <kern/sched.h>
+#include <kern/picirq.h>
+#include <kern/memops.h>
+
+static void boot_aps(void);
 
 // Test the stack backtrace function (lab 1 only)
 void
@@ -20,35 +31,109 @@ test_backtrace(int x)
 }
 
 void
-i386_init(void)
+i386_init(uint32_t boot_magic, physaddr_t boot_info)
 {
 	extern char edata[], end[];
+	struct Bootinfo *bi = NULL;
+
+	if (boot_magic == JOS_BOOT_MAGIC)
+		bi = (struct Bootinfo *) (KERNBASE + boot_info);
 
 	// Before doing anything else, complete the ELF loading process.
-	// Clear the uninitialized global data (BSS) section of our program.
+	// Clear the uninitialized global data (BSS) section of our program,
+	// unless our own boot loader already did so while loading us.
 	// This ensures that all static/global variables start out zero.
-	memset(edata, 0, end - edata);
+	if (!bi)
+		memset(edata, 0, end - edata);
+	boot_stamp(BOOT_TS_BSS);
+
+	// Keep the boot loader's milestones along with our own.
+	if (bi && (bi->bi_flags & BI_TSC))
+		memmove(boot_tsc, bi->bi_tsc, sizeof(bi->bi_tsc));
+
+	// Set up the IDT, and this CPU's GDT, TSS and per-CPU data (%gs),
+	// which everything after this may use.  The boot CPU is cpus[0].
+	trap_init();
 
 	// Initialize the console.
 	// Can't call cprintf until after we do this!
 	cons_init();
+	boot_stamp(BOOT_TS_CONSOLE);
 
 	cprintf("6828 decimal is %o octal!\n", 6828);
 
+	// Choose the memcpy and memset that suit this CPU.
+	memops_init();
 
+	// Find out how much memory the machine has, and where.
+	i386_detect_memory(boot_magic, boot_info);
+	page_init();
+	mem_init_mp();
 
+	// Find the other CPUs and start them.
+	mp_init();
+	lapic_init();
 
+	// Take device interrupts on this CPU from here on.
+	pic_init();
+	sti();
 
-
+	boot_aps();
 
 	// Test the stack backtrace function (lab 1 only)
 	test_backtrace(5);
 
 	// Drop into the kernel monitor.
+	boot_stamp(BOOT_TS_MONITOR);
 	while (1)
 		monitor(NULL);
 }
 
+// Start the non-boot (AP) processors.
+static void
+boot_aps(void)
+{
+	extern unsigned char mpentry_start[], mpentry_end[];
+	void *code;
+	struct CpuInfo *c;
+	uint64_t deadline;
+
+	// Write entry code to unused memory at MPENTRY_PADDR
+	code = KADDR(MPENTRY_PADDR);
+	memmove(code, mpentry_start, mpentry_end - mpentry_start);
+
+	// Boot each AP one at a time
+	for (c = cpus; c < cpus + ncpu; c++) {
+		if (c == cpus + cpunum())  // We've started already.
+			continue;
+
+		// Start the CPU at mpentry_start, which finds its own stack
+		lapic_startap(c->cpu_apicid, PADDR(code));
+		// Wait (up to a second) for the CPU to finish some basic
+		// setup in mp_main()
+		deadline = read_tsc() + (uint64_t) tsc_khz() * 1000;
+		while (c->cpu_status != CPU_STARTED && read_tsc() < deadline)
+			pause();
+		if (c->cpu_status != CPU_STARTED)
+			cprintf("SMP: CPU %d did not start\n", c->cpu_id);
+	}
+}
+
+// Setup code for APs
+void
+mp_main(void)
+{
+	memops_init_percpu();
+	trap_init_percpu();
+	lapic_init();
+	cprintf("SMP: CPU %d starting\n", cpunum());
+
+	xchg(&thiscpu->cpu_status, CPU_STARTED); // tell boot_aps() we're up
+
+	// Park in the idle loop until there is work to do.
+	sched_idle();
+}
+
 
 /*
  * Variable panicstr contains argument to first call to panic; used as flag
@@ -69,6 +154,9 @@ _panic(const char *file, int line, const char *fmt,...)
 		goto dead;
 	panicstr = fmt;
 
+	// Nobody may be left to drain buffered output.
+	cons_sync();
+
 	va_start(ap, fmt);
 	cprintf("kernel panic at %s:%d: ", file, line);
 	vcprintf(fmt, ap);
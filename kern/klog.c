@@ -0,0 +1,118 @@
+// Deferred-format binary log (see kern/klog.h).
+
+#include <inc/types.h>
+#include <inc/stdio.h>
+#include <inc/stdarg.h>
+#include <inc/string.h>
+#include <inc/x86.h>
+#include <inc/mmu.h>
+
+#include <kern/cpu.h>
+#include <kern/tsc.h>
+#include <kern/klog.h>
+
+// One CPU's ring.  Only that CPU writes records; klog_print and
+// klog_dump read them, and are meant to run while the other CPUs are
+// quiet (from the monitor, or after a panic).
+struct klogring {
+	uint32_t head;			// records ever written
+	uint32_t tail;			// records already printed
+	struct klogrec rec[KLOG_NREC];
+};
+
+static struct klogring klogring[NCPU];
+
+void
+klog_record(const char *fmt, int nwords, ...)
+{
+	struct klogring *r;
+	struct klogrec *kr;
+	uint32_t eflags;
+	va_list ap;
+
+	// An interrupt handler on this CPU must not log into the
+	// record we are filling.
+	eflags = read_eflags();
+	cli();
+	r = &klogring[cpunum()];
+	kr = &r->rec[r->head & (KLOG_NREC - 1)];
+	kr->kr_fmt = fmt;
+	kr->kr_tsc = read_tsc();
+	kr->kr_cpu = cpunum();
+	kr->kr_nwords = MIN(nwords, KLOG_MAXWORDS);
+	va_start(ap, nwords);
+	memcpy(kr->kr_args, ap, kr->kr_nwords * sizeof(uint32_t));
+	va_end(ap);
+	r->head++;
+	if (eflags & FL_IF)
+		sti();
+}
+
+// Return the oldest unprinted record of all CPUs, and consume it,
+// or return NULL if there are none.  Reports records lost to ring
+// overflow along the way.
+static struct klogrec *
+klog_next(void)
+{
+	struct klogring *r, *best = NULL;
+	struct klogrec *kr;
+	int i;
+
+	for (i = 0; i < ncpu; i++) {
+		r = &klogring[i];
+		if (r->head - r->tail > KLOG_NREC) {
+			cprintf("klog: CPU %d lost %u records\n", i,
+				r->head - r->tail - KLOG_NREC);
+			r->tail = r->head - KLOG_NREC;
+		}
+		if (r->tail != r->head
+		    && (!best || r->rec[r->tail & (KLOG_NREC - 1)].kr_tsc
+			< best->rec[best->tail & (KLOG_NREC - 1)].kr_tsc))
+			best = r;
+	}
+	if (!best)
+		return NULL;
+	kr = &best->rec[best->tail & (KLOG_NREC - 1)];
+	best->tail++;
+	return kr;
+}
+
+// Format and print the records not yet printed, oldest first,
+// merging the CPUs' rings by timestamp.
+void
+klog_print(void)
+{
+	struct klogrec *kr;
+	uint64_t t0 = 0;
+
+	while ((kr = klog_next()) != NULL) {
+		if (t0 == 0)
+			t0 = kr->kr_tsc;
+		cprintf("[%d] %8llu us: ", kr->kr_cpu,
+			tsc_to_us(kr->kr_tsc - t0));
+		// The JOS va_list is a pointer to the argument words,
+		// so the saved words can stand in for the stack.
+		vcprintf(kr->kr_fmt, (va_list) kr->kr_args);
+	}
+}
+
+// Print the records not yet printed as "@klog" lines, for
+// obj/kern/klogdecode to format off-line:
+//	@klog khz <TSC kHz>
+//	@klog <cpu> <tsc> <fmt> <nwords> <word>...
+// with the tsc, fmt, nwords and words in hex.
+void
+klog_dump(void)
+{
+	struct klogrec *kr;
+	int i;
+
+	cprintf("@klog khz %u\n", tsc_khz());
+	while ((kr = klog_next()) != NULL) {
+		cprintf("@klog %d %llx %08x %x", kr->kr_cpu, kr->kr_tsc,
+			kr->kr_fmt, kr->kr_nwords);
+		for (i = 0; i < kr->kr_nwords; i++)
+			cprintf(" %x", kr->kr_args[i]);
+		cprintf("\n");
+	}
+}
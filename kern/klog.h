@@ -0,0 +1,69 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_KLOG_H
+#define JOS_KERN_KLOG_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+
+// Deferred-format binary log.
+//
+// klog(fmt, ...) costs about as much as a function call: it stores
+// the format pointer, a TSC timestamp, the CPU number and the raw
+// argument words in the calling CPU's ring, and formats nothing.
+// The records are formatted later, by klog_print() (the 'klog'
+// monitor command), or off-line: klog_dump() prints them as "@klog"
+// lines that obj/kern/klogdecode formats against obj/kern/kernel.
+//
+// The format must be a string constant, and so must any %s argument:
+// only the pointers are recorded.  Each ring keeps the most recent
+// KLOG_NREC records.  klog may be used only once the calling CPU's
+// %gs is set up (see trap_init_percpu).  A call whose arguments take
+// more than KLOG_MAXWORDS words does not compile.
+
+#define KLOG_NREC	256	// records per CPU; must be a power of 2
+#define KLOG_MAXWORDS	12	// argument words per record
+
+struct klogrec {
+	const char *kr_fmt;
+	uint64_t kr_tsc;
+	uint16_t kr_cpu;
+	uint16_t kr_nwords;
+	uint32_t kr_args[KLOG_MAXWORDS];
+} __attribute__((aligned(64)));
+
+// The number of 4-byte stack words taken by the arguments.  The ?:
+// makes arrays decay to pointers and small integers promote to int.
+#define KLOG_W(a)		((sizeof(1 ? (a) : (a)) + 3) / 4)
+#define KLOG_W0()		0
+#define KLOG_W1(a)		KLOG_W(a)
+#define KLOG_W2(a, ...)		(KLOG_W(a) + KLOG_W1(__VA_ARGS__))
+#define KLOG_W3(a, ...)		(KLOG_W(a) + KLOG_W2(__VA_ARGS__))
+#define KLOG_W4(a, ...)		(KLOG_W(a) + KLOG_W3(__VA_ARGS__))
+#define KLOG_W5(a, ...)		(KLOG_W(a) + KLOG_W4(__VA_ARGS__))
+#define KLOG_W6(a, ...)		(KLOG_W(a) + KLOG_W5(__VA_ARGS__))
+#define KLOG_W7(a, ...)		(KLOG_W(a) + KLOG_W6(__VA_ARGS__))
+#define KLOG_W8(a, ...)		(KLOG_W(a) + KLOG_W7(__VA_ARGS__))
+#define KLOG_PICK(_0, _1, _2, _3, _4, _5, _6, _7, _8, N, ...)	N
+#define KLOG_NWORDS(...)						\
+	KLOG_PICK(_0, ##__VA_ARGS__, KLOG_W8, KLOG_W7, KLOG_W6,		\
+		  KLOG_W5, KLOG_W4, KLOG_W3, KLOG_W2, KLOG_W1,		\
+		  KLOG_W0)(__VA_ARGS__)
+
+// KLOG_NWORDS(...), or a compile error (an array of negative size)
+// if the arguments would not fit in a record.
+#define KLOG_NWORDS_CHECKED(...)					\
+	((int) (KLOG_NWORDS(__VA_ARGS__) + 0 *				\
+		sizeof(char[KLOG_NWORDS(__VA_ARGS__) <= KLOG_MAXWORDS	\
+			    ? 1 : -1])))
+
+#define klog(fmt, ...)							\
+	klog_record(fmt, KLOG_NWORDS_CHECKED(__VA_ARGS__), ##__VA_ARGS__)
+
+void klog_record(const char *fmt, int nwords, ...);
+void klog_print(void);
+void klog_dump(void);
+
+#endif	// !JOS_KERN_KLOG_H
@@ -0,0 +1,193 @@
+/*
+ * klogdecode: format a kernel binary log off-line.
+ *
+ *	klogdecode obj/kern/kernel < console-output
+ *
+ * Reads the "@klog" lines that the kernel monitor's 'klog dump'
+ * command prints (see kern/klog.c), looks up each record's format
+ * string, and any %s arguments, in the kernel's ELF image, and prints
+ * the formatted records.  Other input lines are ignored, so the whole
+ * serial console log can be fed in.  This is a host program, built
+ * with $(NCC).
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <inc/elf.h>
+
+static uint8_t *kern;
+static size_t kernlen;
+
+static void
+readkernel(const char *name)
+{
+	FILE *f;
+	long len;
+
+	if ((f = fopen(name, "rb")) == NULL
+	    || fseek(f, 0, SEEK_END) < 0 || (len = ftell(f)) < 0
+	    || fseek(f, 0, SEEK_SET) < 0) {
+		perror(name);
+		exit(1);
+	}
+	if ((kern = malloc(len + 1)) == NULL || fread(kern, 1, len, f) != len) {
+		fprintf(stderr, "%s: short read\n", name);
+		exit(1);
+	}
+	fclose(f);
+	kern[len] = 0;
+	kernlen = len;
+	if (kernlen < sizeof(struct Elf)
+	    || ((struct Elf *) kern)->e_magic != ELF_MAGIC) {
+		fprintf(stderr, "%s: not an ELF kernel\n", name);
+		exit(1);
+	}
+}
+
+// Return the NUL-terminated string at kernel virtual address va,
+// or NULL if va is not in the file contents of a loadable segment.
+static const char *
+kstring(uint32_t va)
+{
+	struct Elf *elf = (struct Elf *) kern;
+	struct Proghdr *ph;
+	int i;
+
+	ph = (struct Proghdr *) (kern + elf->e_phoff);
+	for (i = 0; i < elf->e_phnum; i++, ph++)
+		if (ph->p_type == ELF_PROG_LOAD && va >= ph->p_va
+		    && va - ph->p_va < ph->p_filesz
+		    && ph->p_offset + ph->p_filesz <= kernlen)
+			return (const char *) kern + ph->p_offset + (va - ph->p_va);
+	return NULL;
+}
+
+// Format one record, translating each JOS conversion to the host's
+// printf.  Records are short, so overruns just truncate.
+static void
+decode(const char *fmt, const uint32_t *w, int nw)
+{
+	char spec[32];
+	const char *s, *start;
+	uint64_t v;
+	int i = 0, n, lflag;
+
+#define NEXT()	(i < nw ? w[i++] : 0)
+	while (*fmt) {
+		if (*fmt != '%') {
+			putchar(*fmt++);
+			continue;
+		}
+
+		// Copy the flags and width, fetching any '*' argument.
+		start = fmt++;
+		n = 0;
+		spec[n++] = '%';
+		for (; strchr("-0#.123456789*", *fmt) && n < 16; fmt++) {
+			if (*fmt == '*')
+				n += sprintf(spec + n, "%d", (int) NEXT());
+			else
+				spec[n++] = *fmt;
+		}
+		for (lflag = 0; *fmt == 'l'; fmt++)
+			lflag++;
+		spec[n] = 0;
+
+		switch (*fmt) {
+		case 'd':
+		case 'u':
+		case 'o':
+		case 'x':
+			v = NEXT();
+			if (lflag >= 2)
+				v |= (uint64_t) NEXT() << 32;
+			else if (*fmt == 'd')
+				v = (int64_t) (int32_t) v;
+			strcat(spec, *fmt == 'd' ? "lld" : *fmt == 'u' ? "llu"
+			       : *fmt == 'o' ? "llo" : "llx");
+			printf(spec, v);
+			break;
+		case 'p':
+			printf("0x%x", NEXT());
+			break;
+		case 'c':
+			strcat(spec, "c");
+			printf(spec, (int) NEXT());
+			break;
+		case 'e':
+			printf("error %d", (int) NEXT());
+			break;
+		case 's':
+			v = NEXT();
+			if (v == 0)
+				s = "(null)";
+			else if ((s = kstring(v)) == NULL) {
+				printf("<string at 0x%x>", (unsigned) v);
+				break;
+			}
+			strcat(spec, "s");
+			printf(spec, s);
+			break;
+		case '%':
+			putchar('%');
+			break;
+		default:
+			// Unknown conversion: print it literally, as the
+			// kernel does.
+			printf("%.*s", (int) (fmt - start + (*fmt != 0)), start);
+			break;
+		}
+		if (*fmt)
+			fmt++;
+	}
+#undef NEXT
+}
+
+int
+main(int argc, char **argv)
+{
+	char line[1024];
+	unsigned long long tsc, t0 = 0;
+	unsigned khz = 0, cpu, va, nw;
+	uint32_t w[64];
+	const char *fmt;
+	char *p;
+	int i, off;
+
+	if (argc != 2) {
+		fprintf(stderr, "usage: klogdecode kernel < log\n");
+		exit(2);
+	}
+	readkernel(argv[1]);
+
+	while (fgets(line, sizeof(line), stdin)) {
+		if ((p = strstr(line, "@klog ")) == NULL)
+			continue;
+		p += 6;
+		if (sscanf(p, "khz %u", &khz) == 1)
+			continue;
+		if (sscanf(p, "%u %llx %x %x%n", &cpu, &tsc, &va, &nw, &off) != 4
+		    || nw > 64)
+			continue;
+		for (p += off, i = 0; i < nw; i++, p += off)
+			if (sscanf(p, "%x%n", &w[i], &off) != 1)
+				break;
+		if (i < nw)
+			continue;
+
+		if (t0 == 0)
+			t0 = tsc;
+		if (khz)
+			printf("[%u] %8llu us: ", cpu, (tsc - t0) * 1000 / khz);
+		else
+			printf("[%u] %12llu: ", cpu, tsc - t0);
+		if ((fmt = kstring(va)) == NULL)
+			printf("<format at 0x%x>\n", va);
+		else
+			decode(fmt, w, nw);
+	}
+	return 0;
+}
@@ -0,0 +1,205 @@
+/* See COPYRIGHT for copyright information. */
+
+// Pick memcpy and memset variants for the CPU we are running on.
+//
+// lib/string.c has versions that suit any x86.  At boot, memops_init()
+// looks at CPUID and, if this CPU has something better, overwrites the
+// entry of memcpy and memset with a jump to the better variant.
+// Callers keep making direct calls, so the choice is made once and
+// costs one direct jump per call.  memmove hands copies between
+// buffers that do not overlap to memcpy, so it gains too.
+
+#include <inc/x86.h>
+#include <inc/mmu.h>
+#include <inc/stdio.h>
+#include <inc/string.h>
+
+#include <kern/memops.h>
+
+uint32_t cpu_features;
+static const char *variant = "generic";
+
+// Below this size, saving and restoring the XMM registers costs more
+// than the SSE2 loops save.
+#define SSE2_MIN	256
+
+// Move n bytes forward from *sp to *dp with rep movsl and rep movsb,
+// advancing both pointers.
+static __inline void
+movs(char **dp, const char **sp, size_t n)
+{
+	size_t w = n / 4, b = n % 4;
+
+	asm volatile("cld; rep movsl\n"
+		: "+D" (*dp), "+S" (*sp), "+c" (w) :: "cc", "memory");
+	asm volatile("rep movsb\n"
+		: "+D" (*dp), "+S" (*sp), "+c" (b) :: "cc", "memory");
+}
+
+// Store n copies of the byte in c (replicated in all four bytes)
+// at *dp, advancing it.
+static __inline void
+stos(char **dp, uint32_t c, size_t n)
+{
+	size_t w = n / 4, b = n % 4;
+
+	asm volatile("cld; rep stosl\n"
+		: "+D" (*dp), "+c" (w) : "a" (c) : "cc", "memory");
+	asm volatile("rep stosb\n"
+		: "+D" (*dp), "+c" (b) : "a" (c) : "cc", "memory");
+}
+
+// Enhanced REP MOVSB/STOSB: the byte string instructions move whole
+// cache lines at a time, at any alignment, and beat anything we could
+// write by hand.
+static void *
+memcpy_erms(void *dst, const void *src, size_t n)
+{
+	char *d = dst;
+
+	asm volatile("cld; rep movsb\n"
+		: "+D" (d), "+S" (src), "+c" (n) :: "cc", "memory");
+	return dst;
+}
+
+static void *
+memset_erms(void *v, int c, size_t n)
+{
+	char *p = v;
+
+	asm volatile("cld; rep stosb\n"
+		: "+D" (p), "+c" (n) : "a" (c) : "cc", "memory");
+	return v;
+}
+
+// The SSE2 variants use only xmm0-3.  Traps do not save the XMM
+// registers, and code we interrupted may be using them (possibly an
+// SSE2 copy of its own), so we put back the ones we use.  Plain moves
+// change no other FPU or SSE state.
+#define XMM_SAVE(buf)							\
+	asm volatile("movdqu %%xmm0, 0(%0); movdqu %%xmm1, 16(%0)\n"	\
+		     "movdqu %%xmm2, 32(%0); movdqu %%xmm3, 48(%0)\n"	\
+		     : : "r" (buf) : "memory")
+#define XMM_RESTORE(buf)						\
+	asm volatile("movdqu 0(%0), %%xmm0; movdqu 16(%0), %%xmm1\n"	\
+		     "movdqu 32(%0), %%xmm2; movdqu 48(%0), %%xmm3\n"	\
+		     : : "r" (buf) : "memory")
+
+static void *
+memcpy_sse2(void *dst, const void *src, size_t n)
+{
+	char *d = dst;
+	const char *s = src;
+	size_t m;
+	uint8_t xmm[64];
+
+	if (n >= SSE2_MIN) {
+		// up to where d is 16-byte aligned, then 64 bytes a round
+		m = -(uintptr_t) d & 15;
+		movs(&d, &s, m);
+		n -= m;
+		m = n / 64;
+		XMM_SAVE(xmm);
+		asm volatile("1: movdqu 0(%1), %%xmm0; movdqu 16(%1), %%xmm1\n"
+			     "movdqu 32(%1), %%xmm2; movdqu 48(%1), %%xmm3\n"
+			     "movdqa %%xmm0, 0(%0); movdqa %%xmm1, 16(%0)\n"
+			     "movdqa %%xmm2, 32(%0); movdqa %%xmm3, 48(%0)\n"
+			     "add $64, %0; add $64, %1; dec %2; jnz 1b\n"
+			     : "+r" (d), "+r" (s), "+r" (m) :: "cc", "memory");
+		XMM_RESTORE(xmm);
+		n %= 64;
+	}
+	movs(&d, &s, n);
+	return dst;
+}
+
+static void *
+memset_sse2(void *v, int c, size_t n)
+{
+	char *p = v;
+	size_t m;
+	uint8_t xmm[64];
+
+	c = (c & 0xFF) * 0x01010101;
+	if (n >= SSE2_MIN) {
+		m = -(uintptr_t) p & 15;
+		stos(&p, c, m);
+		n -= m;
+		m = n / 64;
+		XMM_SAVE(xmm);
+		asm volatile("movd %2, %%xmm0; pshufd $0, %%xmm0, %%xmm0\n"
+			     "1: movdqa %%xmm0, 0(%0); movdqa %%xmm0, 16(%0)\n"
+			     "movdqa %%xmm0, 32(%0); movdqa %%xmm0, 48(%0)\n"
+			     "add $64, %0; dec %1; jnz 1b\n"
+			     : "+r" (p), "+r" (m) : "r" (c)
+			     : "cc", "memory");
+		XMM_RESTORE(xmm);
+		n %= 64;
+	}
+	stos(&p, c, n);
+	return v;
+}
+
+// Overwrite the entry of fn with a jump to to.  Only the boot CPU is
+// running, with interrupts off, so nothing can be executing fn.
+static void
+patch_jmp(void *fn, void *to)
+{
+	uint8_t *p = fn;
+
+	p[0] = 0xE9;	// jmp rel32
+	*(int32_t *) (p + 1) = (uint8_t *) to - (p + 5);
+}
+
+void
+memops_init(void)
+{
+	uint32_t maxleaf, ebx, ecx, edx;
+
+	cpuid(0, &maxleaf, NULL, NULL, NULL);
+	cpuid(1, NULL, NULL, &ecx, &edx);
+	if (edx & (1 << 26))
+		cpu_features |= CPUF_SSE2;
+	if (edx & (1 << 24))
+		cpu_features |= CPUF_FXSR;
+	if (ecx & (1 << 28))
+		cpu_features |= CPUF_AVX;
+	if (maxleaf >= 7) {
+		cpuid(7, NULL, &ebx, NULL, NULL);
+		if (ebx & (1 << 9))
+			cpu_features |= CPUF_ERMS;
+	}
+	memops_init_percpu();
+
+	// There is no AVX variant: its YMM state needs XSAVE to preserve,
+	// and CPUs with AVX nearly all have ERMS, which wins anyway.
+	if (cpu_features & CPUF_ERMS) {
+		patch_jmp(memcpy, memcpy_erms);
+		patch_jmp(memset, memset_erms);
+		variant = "erms";
+	} else if ((cpu_features & (CPUF_SSE2|CPUF_FXSR))
+		   == (CPUF_SSE2|CPUF_FXSR)) {
+		patch_jmp(memcpy, memcpy_sse2);
+		patch_jmp(memset, memset_sse2);
+		variant = "sse2";
+	}
+	cprintf("memops: %s memcpy and memset\n", variant);
+}
+
+// Let this CPU run SSE instructions, which the SSE2 variants need.
+// Every CPU must call this before it calls memcpy or memset.
+void
+memops_init_percpu(void)
+{
+	if ((cpu_features & (CPUF_SSE2|CPUF_FXSR)) != (CPUF_SSE2|CPUF_FXSR))
+		return;
+	lcr4(rcr4() | CR4_OSFXSR | CR4_OSXMMEXCPT);
+	lcr0((rcr0() & ~(CR0_EM|CR0_TS)) | CR0_MP);
+}
+
+// Name the variant memops_init() chose.
+const char *
+memops_variant(void)
+{
+	return variant;
+}
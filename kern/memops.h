@@ -0,0 +1,23 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_MEMOPS_H
+#define JOS_KERN_MEMOPS_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+
+// CPU features that matter to the memory routines, in cpu_features
+#define CPUF_SSE2	0x01	// CPUID.1:EDX[26]
+#define CPUF_FXSR	0x02	// CPUID.1:EDX[24], CR4.OSFXSR may be set
+#define CPUF_AVX	0x04	// CPUID.1:ECX[28]
+#define CPUF_ERMS	0x08	// CPUID.7:EBX[9], fast rep movsb/stosb
+
+extern uint32_t cpu_features;
+
+void memops_init(void);
+void memops_init_percpu(void);
+const char *memops_variant(void);
+
+#endif	// !JOS_KERN_MEMOPS_H
@@ -6,10 +6,18 @@
 #include <inc/memlayout.h>
 #include <inc/assert.h>
 #include <inc/x86.h>
+#include <inc/error.h>
 
 #include <kern/console.h>
 #include <kern/monitor.h>
 #include <kern/kdebug.h>
+#include <kern/tsc.h>
+#include <kern/pmap.h>
+#include <kern/cpu.h>
+#include <kern/sched.h>
+#include <kern/spinlock.h>
+#include <kern/klog.h>
+#include <kern/bench.h>
 
 #define CMDBUF_SIZE	80	// enough for one VGA text line
 
@@ -25,6 +33,12 @@ static struct Command commands[] = {
 	{ "help"	, "Display this list of commands", mon_help },
 	{ "kerninfo"	, "Display information about the kernel", mon_kerninfo },
 	{ "backtrace"	, "Display a listing of function call frames", mon_backtrace }, 
+	{ "boottime"	, "Display the time taken by each boot stage", mon_boottime },
+	{ "memscan"	, "Time a page-stride memory scan with 4KB and 4MB pages", mon_memscan },
+	{ "lockbench"	, "Measure lock throughput with all CPUs contending", mon_lockbench },
+	{ "klog"	, "Print the binary log ('klog dump' for klogdecode)", mon_klog },
+	{ "cons"	, "List console output devices, or turn one on or off", mon_cons },
+	{ "bench"	, "List or run the kernel microbenchmarks", mon_bench },
 };
 #define NCOMMANDS (sizeof(commands)/sizeof(commands[0]))
 
@@ -85,7 +99,268 @@ mon_backtrace(int argc, char **argv, struct Trapframe *tf)
 	return 0;
 }
 
+// Names of the boot milestones, indexed by BOOT_TS_*
+static const char *boot_stage[BOOT_NSTAMP] = {
+	[BOOT_TS_START]		= "boot sector",
+	[BOOT_TS_BOOTMAIN]	= "bootmain",
+	[BOOT_TS_STAGE2]	= "stage 2",
+	[BOOT_TS_LOADED]	= "kernel loaded",
+	[BOOT_TS_ENTRY]		= "kernel entry",
+	[BOOT_TS_RELOCATED]	= "relocated",
+	[BOOT_TS_BSS]		= "BSS clear",
+	[BOOT_TS_CONSOLE]	= "console",
+	[BOOT_TS_MONITOR]	= "monitor",
+};
+
+int
+mon_boottime(int argc, char **argv, struct Trapframe *tf)
+{
+	uint64_t prev = 0;
+	int i;
+
+	// Each line shows the time from the previous milestone (or from
+	// CPU reset, for the first) until this one was reached.
+	cprintf("TSC %u kHz\n", tsc_khz());
+	cprintf("%-14s %12s %10s %10s\n", "milestone", "cycles", "us", "total us");
+	for (i = 0; i < BOOT_NSTAMP; i++) {
+		if (boot_tsc[i] == 0)
+			continue;
+		cprintf("%-14s %12llu %10llu %10llu\n", boot_stage[i],
+			boot_tsc[i] - prev, tsc_to_us(boot_tsc[i] - prev),
+			tsc_to_us(boot_tsc[i]));
+		prev = boot_tsc[i];
+	}
+	return 0;
+}
+
+// Scratch linear address at which memscan maps memory with 4KB pages
+#define MEMSCAN_VA	0x40000000
+
+// Read one byte every 'stride' bytes of [va, va+size), 'passes' times,
+// reloading %cr3 before each pass as a context switch would.
+// Returns the total cycles spent scanning.
+static uint64_t
+memscan_pass(volatile char *va, size_t size, size_t stride, int passes)
+{
+	uint64_t t, total = 0;
+	size_t off;
+
+	while (passes-- > 0) {
+		lcr3(rcr3());
+		t = read_tsc();
+		for (off = 0; off < size; off += stride)
+			(void) va[off];
+		total += read_tsc() - t;
+	}
+	return total;
+}
+
+// memscan [MB [stride [passes]]]
+// Scans the same physical memory, starting at 4MB, through a
+// temporary 4KB-page mapping and through the KERNBASE window's 4MB
+// global pages, so that the difference is the cost of TLB misses.
+int
+mon_memscan(int argc, char **argv, struct Trapframe *tf)
+{
+	size_t mb = 64, stride = PGSIZE, size, naccess;
+	int passes = 4;
+	uint64_t t4k, t4m;
+
+	if (argc > 1)
+		mb = strtol(argv[1], 0, 0);
+	if (argc > 2)
+		stride = strtol(argv[2], 0, 0);
+	if (argc > 3)
+		passes = strtol(argv[3], 0, 0);
+	if (stride == 0 || passes <= 0) {
+		cprintf("Usage: memscan [MB [stride [passes]]]\n");
+		return 0;
+	}
+
+	// Stay within memory, in whole 4MB pages above the first.  Clamp
+	// mb before scaling it, or a big one would wrap to a small size.
+	size = ROUNDDOWN(MIN(mb, (npage * PGSIZE - PTSIZE) >> 20) << 20, PTSIZE);
+	if (size == 0) {
+		cprintf("memscan: not enough memory\n");
+		return 0;
+	}
+	if (boot_map_segment(boot_pgdir, MEMSCAN_VA, size, PTSIZE, PTE_W) < 0) {
+		cprintf("memscan: out of memory for page tables\n");
+		boot_unmap_segment(boot_pgdir, MEMSCAN_VA, size);
+		return 0;
+	}
+	t4k = memscan_pass((char *) MEMSCAN_VA, size, stride, passes);
+	t4m = memscan_pass((char *) KADDR(PTSIZE), size, stride, passes);
+	boot_unmap_segment(boot_pgdir, MEMSCAN_VA, size);
+
+	naccess = (size + stride - 1) / stride * passes;
+	cprintf("memscan: %uMB, stride %u, %d passes\n", size >> 20, stride,
+		passes);
+	cprintf("  4KB pages:        %llu cycles/access\n", t4k / naccess);
+	cprintf("  4MB global pages: %llu cycles/access\n", t4m / naccess);
+	return 0;
+}
+
+
+// Lock types that lockbench compares
+enum {
+	LB_ATOMIC = 0,		// lock xadd on the counter, no lock
+	LB_TICKET,
+	LB_MCS,
+	LB_NTYPE
+};
+
+static const char *lockbench_name[LB_NTYPE] = {
+	[LB_ATOMIC]	= "atomic xadd",
+	[LB_TICKET]	= "ticket spinlock",
+	[LB_MCS]	= "MCS lock",
+};
+
+static struct {
+	int type;
+	uint32_t iters;
+	volatile uint32_t go;		// set once every CPU is waiting
+	volatile uint32_t counter;	// the shared counter under test
+} lb;
+
+static struct spinlock lb_ticket = SPINLOCK_INITIALIZER(lb_ticket);
+static struct mcslock lb_mcs = MCSLOCK_INITIALIZER(lb_mcs);
+
+// Increment the shared counter lb.iters times under the lock being
+// measured.  Runs on every CPU at once.
+static void
+lockbench_worker(void *arg)
+{
+	struct mcsnode me;
+	uint32_t i;
+
+	while (!lb.go)
+		pause();
+	for (i = 0; i < lb.iters; i++) {
+		switch (lb.type) {
+		case LB_ATOMIC:
+			xadd(&lb.counter, 1);
+			break;
+		case LB_TICKET:
+			spin_lock(&lb_ticket);
+			lb.counter++;
+			spin_unlock(&lb_ticket);
+			break;
+		case LB_MCS:
+			mcs_lock(&lb_mcs, &me);
+			lb.counter++;
+			mcs_unlock(&lb_mcs, &me);
+			break;
+		}
+	}
+}
+
+// lockbench [iterations]
+// Hammers one shared counter from every CPU, once per lock type, and
+// reports the aggregate throughput.
+int
+mon_lockbench(int argc, char **argv, struct Trapframe *tf)
+{
+	uint32_t iters = 100000, ops;
+	uint64_t t;
+	int type, i, n;
 
+	if (argc > 1)
+		iters = strtol(argv[1], 0, 0);
+	if (iters == 0) {
+		cprintf("Usage: lockbench [iterations]\n");
+		return 0;
+	}
+
+#ifdef DEBUG_SPINLOCK
+	cprintf("lockbench: DEBUG_SPINLOCK is on; lock timings include owner tracking\n");
+#endif
+	for (type = 0; type < LB_NTYPE; type++) {
+		lb.type = type;
+		lb.iters = iters;
+		lb.counter = 0;
+		lb.go = 0;
+
+		// Park every other running CPU at the starting line,
+		// then start them all together and join in.
+		n = 1;
+		for (i = 0; i < ncpu; i++)
+			if (i != cpunum() && sched_call(i, lockbench_worker, 0) == 0)
+				n++;
+		t = read_tsc();
+		lb.go = 1;
+		lockbench_worker(0);
+		for (i = 0; i < ncpu; i++)
+			if (i != cpunum())
+				sched_wait(i);
+		t = read_tsc() - t;
+
+		ops = n * iters;
+		cprintf("%-16s %d CPUs: %llu cycles/op, %llu Kops/s",
+			lockbench_name[type], n, t / ops,
+			(uint64_t) ops * tsc_khz() / (t ? t : 1));
+		if (lb.counter != ops)
+			cprintf(" (counter %u, expected %u!)", lb.counter, ops);
+		cprintf("\n");
+	}
+	return 0;
+}
+
+// klog [dump]
+int
+mon_klog(int argc, char **argv, struct Trapframe *tf)
+{
+	if (argc == 1)
+		klog_print();
+	else if (strcmp(argv[1], "dump") == 0)
+		klog_dump();
+	else
+		cprintf("Usage: klog [dump]\n");
+	return 0;
+}
+
+// cons [sink on|off]
+int
+mon_cons(int argc, char **argv, struct Trapframe *tf)
+{
+	if (argc == 1)
+		cons_sink_print();
+	else if (argc != 3 || (strcmp(argv[2], "on") != 0
+			       && strcmp(argv[2], "off") != 0))
+		cprintf("Usage: cons [sink on|off]\n");
+	else if (cons_sink_enable(argv[1], strcmp(argv[2], "on") == 0) < 0)
+		cprintf("cons: no sink '%s'\n", argv[1]);
+	return 0;
+}
+
+// bench [-m] [-n samples] [all | name...]
+int
+mon_bench(int argc, char **argv, struct Trapframe *tf)
+{
+	int i, nsample = BENCH_NSAMPLE;
+	bool raw = 0;
+
+	for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+		if (strcmp(argv[i], "-m") == 0)
+			raw = 1;
+		else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+			nsample = strtol(argv[++i], 0, 0);
+		else
+			goto usage;
+	}
+	if (nsample <= 0 || nsample > BENCH_MAXSAMPLE)
+		goto usage;
+	if (i == argc)
+		bench_list();
+	else
+		bench_run(argc - i, argv + i, nsample, raw);
+	return 0;
+
+usage:
+	cprintf("Usage: bench [-m] [-n samples (1-%d)] [all | name...]\n",
+		BENCH_MAXSAMPLE);
+	return 0;
+}
 
 
 /***** Kernel monitor command interpreter *****/
@@ -113,7 +388,7 @@ runcmd(char *buf, struct Trapframe *tf)
 		// save and scan past next arg
 		if (argc == MAXARGS-1) {
 			cprintf("Too many arguments (max %d)\n", MAXARGS);
-			return 0;
+			return -E_INVAL;
 		}
 		argv[argc++] = buf;
 		while (*buf && !strchr(WHITESPACE, *buf))
@@ -129,7 +404,80 @@ runcmd(char *buf, struct Trapframe *tf)
 			return commands[i].func(argc, argv, tf);
 	}
 	cprintf("Unknown command '%s'\n", argv[0]);
-	return 0;
+	return -E_INVAL;
+}
+
+
+/***** Batch mode *****/
+
+// If the kernel is built with MON_BATCH set (see GNUmakefile), the
+// first entry to monitor() runs those ';'-separated commands instead
+// of prompting, or, if MON_BATCH is "-", commands read from the
+// console a line at a time up to a line "end".  Markers around each
+// command let a script watching the serial console follow along:
+//	@mon batch begin
+//	@mon cmd <n> <command>
+//	@mon status <n> <runcmd's return value; nonzero means failure>
+//	@mon batch end <number of failed commands>
+// Then the kernel powers the machine off.  A batch command that
+// panics (or otherwise re-enters the monitor) ends the batch at once.
+
+static enum { BATCH_PENDING, BATCH_RUNNING, BATCH_DONE } batch_state;
+
+// Power off under QEMU or Bochs, or failing that, halt.
+static void
+poweroff(void)
+{
+	const char *s;
+
+	cons_sync();
+	outw(0x604, 0x2000);		// QEMU's ACPI PM1a control, S5
+	outw(0xB004, 0x2000);		// the same before QEMU 2.0
+	for (s = "Shutdown"; *s; s++)	// Bochs and old QEMU
+		outb(0x8900, *s);
+	cprintf("@mon halted\n");
+	cli();
+	while (1)
+		__asm __volatile("hlt");
+}
+
+// Run one batch command, numbered n, with markers around it.
+// Returns runcmd's result.
+static int
+batch_cmd(int n, char *cmd, struct Trapframe *tf)
+{
+	int r;
+
+	cprintf("@mon cmd %d %s\n", n, cmd);
+	r = runcmd(cmd, tf);
+	cprintf("@mon status %d %d\n", n, r);
+	return r;
+}
+
+static void
+batch(struct Trapframe *tf)
+{
+	static char script[] = MON_BATCH;
+	char *cmd, *next;
+	int n = 0, nfail = 0, r = 0;
+
+	batch_state = BATCH_RUNNING;
+	cprintf("@mon batch begin\n");
+	if (strcmp(script, "-") == 0) {
+		while (r != -1 && (cmd = readline(NULL)) != NULL
+		       && strcmp(cmd, "end") != 0)
+			if ((r = batch_cmd(++n, cmd, tf)) != 0)
+				nfail++;
+	} else
+		for (cmd = script; cmd && r != -1; cmd = next) {
+			if ((next = strchr(cmd, ';')) != NULL)
+				*next++ = '\0';
+			if ((r = batch_cmd(++n, cmd, tf)) != 0)
+				nfail++;
+		}
+	cprintf("@mon batch end %d\n", nfail);
+	batch_state = BATCH_DONE;
+	poweroff();
 }
 
 void
@@ -137,6 +485,13 @@ monitor(struct Trapframe *tf)
 {
 	char *buf;
 
+	if (batch_state == BATCH_RUNNING) {
+		cprintf("@mon batch end aborted\n");
+		poweroff();
+	}
+	if (batch_state == BATCH_PENDING && MON_BATCH[0] != '\0')
+		batch(tf);
+
 	cprintf("Welcome to the JOS kernel monitor!\n");
 	cprintf("Type 'help' for a list of commands.\n");
 
@@ -144,7 +499,8 @@ monitor(struct Trapframe *tf)
 	while (1) {
 		buf = readline("K> ");
 		if (buf != NULL)
-			if (runcmd(buf, tf) < 0)
+			// -1 exits the monitor; other errors just fail the command
+			if (runcmd(buf, tf) == -1)
 				break;
 	}
 }
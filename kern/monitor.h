@@ -15,5 +15,11 @@ void monitor(struct Trapframe *tf);
 int mon_help(int argc, char **argv, struct Trapframe *tf);
 int mon_kerninfo(int argc, char **argv, struct Trapframe *tf);
 int mon_backtrace(int argc, char **argv, struct Trapframe *tf);
+int mon_boottime(int argc, char **argv, struct Trapframe *tf);
+int mon_memscan(int argc, char **argv, struct Trapframe *tf);
+int mon_lockbench(int argc, char **argv, struct Trapframe *tf);
+int mon_klog(int argc, char **argv, struct Trapframe *tf);
+int mon_cons(int argc, char **argv, struct Trapframe *tf);
+int mon_bench(int argc, char **argv, struct Trapframe *tf);
 
 #endif	// !JOS_KERN_MONITOR_H
@@ -0,0 +1,351 @@
+// Search for and parse the ACPI MADT or the multiprocessor
+// configuration table to find the machine's CPUs.
+// See http://developer.intel.com/design/pentium/datashts/24201606.pdf
+// and the ACPI specification, section 5.2.12.
+
+#include <inc/types.h>
+#include <inc/string.h>
+#include <inc/memlayout.h>
+#include <inc/x86.h>
+#include <inc/mmu.h>
+#include <kern/cpu.h>
+#include <kern/pmap.h>
+
+struct CpuInfo cpus[NCPU];
+struct CpuInfo *bootcpu;
+int ismp;
+int ncpu;
+uint8_t cpu_by_apicid[256];
+
+// Per-CPU kernel stacks
+unsigned char percpu_kstacks[NCPU][KSTKSIZE]
+__attribute__ ((aligned(PGSIZE)));
+
+
+// See MultiProcessor Specification Version 1.[14]
+
+struct mp {             // floating pointer [MP 4.1]
+	uint8_t signature[4];           // "_MP_"
+	physaddr_t physaddr;            // phys addr of MP config table
+	uint8_t length;                 // 1
+	uint8_t specrev;                // [14]
+	uint8_t checksum;               // all bytes must add up to 0
+	uint8_t type;                   // MP system config type
+	uint8_t imcrp;
+	uint8_t reserved[3];
+} __attribute__((__packed__));
+
+struct mpconf {         // configuration table header [MP 4.2]
+	uint8_t signature[4];           // "PCMP"
+	uint16_t length;                // total table length
+	uint8_t version;                // [14]
+	uint8_t checksum;               // all bytes must add up to 0
+	uint8_t product[20];            // product id
+	physaddr_t oemtable;            // OEM table pointer
+	uint16_t oemlength;             // OEM table length
+	uint16_t entry;                 // entry count
+	physaddr_t lapicaddr;           // address of local APIC
+	uint16_t xlength;               // extended table length
+	uint8_t xchecksum;              // extended table checksum
+	uint8_t reserved;
+	uint8_t entries[0];             // table entries
+} __attribute__((__packed__));
+
+struct mpproc {         // processor table entry [MP 4.3.1]
+	uint8_t type;                   // entry type (0)
+	uint8_t apicid;                 // local APIC id
+	uint8_t version;                // local APIC version
+	uint8_t flags;                  // CPU flags
+	uint8_t signature[4];           // CPU signature
+	uint32_t feature;               // feature flags from CPUID instruction
+	uint8_t reserved[8];
+} __attribute__((__packed__));
+
+// mpproc flags
+#define MPPROC_BOOT 0x02                // This mpproc is the bootstrap processor
+#define MPPROC_EN   0x01                // This processor is usable
+
+// Table entry types
+#define MPPROC    0x00  // One per processor
+#define MPBUS     0x01  // One per bus
+#define MPIOAPIC  0x02  // One per I/O APIC
+#define MPIOINTR  0x03  // One per bus interrupt source
+#define MPLINTR   0x04  // One per system interrupt source
+
+// ACPI structures
+
+struct rsdp {           // root system description pointer [ACPI 5.2.5]
+	uint8_t signature[8];           // "RSD PTR "
+	uint8_t checksum;               // first 20 bytes must add up to 0
+	uint8_t oemid[6];
+	uint8_t revision;
+	physaddr_t rsdt;                // phys addr of RSDT
+} __attribute__((__packed__));
+
+struct sdthdr {         // system description table header [ACPI 5.2.6]
+	uint8_t signature[4];
+	uint32_t length;                // including this header
+	uint8_t revision;
+	uint8_t checksum;               // all bytes must add up to 0
+	uint8_t oemid[6];
+	uint8_t oemtableid[8];
+	uint32_t oemrevision;
+	uint32_t creatorid;
+	uint32_t creatorrevision;
+} __attribute__((__packed__));
+
+struct madt {           // multiple APIC description table [ACPI 5.2.12]
+	struct sdthdr hdr;              // signature "APIC"
+	physaddr_t lapicaddr;           // address of local APIC
+	uint32_t flags;
+	uint8_t entries[0];             // interrupt controller structures
+} __attribute__((__packed__));
+
+struct madtlapic {      // processor local APIC [ACPI 5.2.12.2]
+	uint8_t type;                   // entry type (0)
+	uint8_t length;                 // 8
+	uint8_t acpiid;                 // ACPI processor id
+	uint8_t apicid;                 // local APIC id
+	uint32_t flags;
+} __attribute__((__packed__));
+
+// madtlapic flags
+#define MADT_LAPIC_EN	0x01            // This processor is usable
+
+// MADT entry types
+#define MADT_LAPIC	0x00
+
+static uint8_t
+sum(void *addr, int len)
+{
+	int i, sum;
+
+	sum = 0;
+	for (i = 0; i < len; i++)
+		sum += ((uint8_t *)addr)[i];
+	return sum;
+}
+
+// Return a kernel virtual address for the 'len' bytes at physical
+// address 'pa'.  Firmware tables may lie beyond the KERNBASE window
+// (ACPI tables usually sit at the top of RAM), in which case they
+// are mapped into the MMIO region.
+static void *
+firmware_map(physaddr_t pa, size_t len)
+{
+	if (pa + len <= MAXPA && pa + len > pa)
+		return (void *) (pa + KERNBASE);
+	return mmio_map_region(pa, len);
+}
+
+// Look for a structure with the given signature, starting on a
+// 16-byte boundary, in the len bytes at physical address a.
+static void *
+scan_low(physaddr_t a, int len, const char *sig, int siglen, int sumlen)
+{
+	uint8_t *p = KADDR(a), *e = KADDR(a + len);
+
+	for (; p < e; p += 16)
+		if (memcmp(p, sig, siglen) == 0 && sum(p, sumlen) == 0)
+			return p;
+	return NULL;
+}
+
+// Search the places the specifications name for the MP floating
+// pointer ("_MP_") or the ACPI RSDP ("RSD PTR "):
+// 1) in the first KB of the EBDA;
+// 2) if there is no EBDA, in the last KB of system base memory;
+// 3) in the BIOS ROM between 0xE0000 and 0xFFFFF.
+static void *
+search_low(const char *sig, int siglen, int sumlen)
+{
+	uint8_t *bda;
+	uint32_t p;
+	void *r;
+
+	static_assert(sizeof(struct mp) == 16);
+
+	// The BIOS data area lives in 16-bit segment 0x40.
+	bda = (uint8_t *) KADDR(0x40 << 4);
+
+	// [MP 4] The 16-bit segment of the EBDA is in the two bytes
+	// starting at byte 0x0E of the BDA.  0 if not present.
+	if ((p = *(uint16_t *) (bda + 0x0E))) {
+		p <<= 4;	// Translate from segment to PA
+		if ((r = scan_low(p, 1024, sig, siglen, sumlen)))
+			return r;
+	} else {
+		// The size of base memory, in KB is in the two bytes
+		// starting at 0x13 of the BDA.
+		p = *(uint16_t *) (bda + 0x13) * 1024;
+		if ((r = scan_low(p - 1024, 1024, sig, siglen, sumlen)))
+			return r;
+	}
+	return scan_low(0xE0000, 0x20000, sig, siglen, sumlen);
+}
+
+// Return the calling CPU's index in cpus[], going by the initial local
+// APIC ID that CPUID reports.  This is for use only until the CPU's
+// %gs is set up; from then on, cpunum() is one instruction.
+int
+cpu_identify(void)
+{
+	uint32_t ebx;
+
+	cpuid(1, NULL, &ebx, NULL, NULL);
+	return cpu_by_apicid[ebx >> 24];
+}
+
+// Record a processor with local APIC ID apicid.  The boot CPU is
+// always cpus[0], which mp_init() fills in itself.
+static void
+add_cpu(uint8_t apicid)
+{
+	if (apicid == cpus[0].cpu_apicid)
+		return;
+	if (ncpu >= NCPU) {
+		cprintf("SMP: too many CPUs, CPU %d disabled\n", apicid);
+		return;
+	}
+	cpus[ncpu].cpu_id = ncpu;
+	cpus[ncpu].cpu_apicid = apicid;
+	cpu_by_apicid[apicid] = ncpu;
+	ncpu++;
+}
+
+// Find the CPUs through the ACPI MADT.  Returns 1 on success.
+static int
+madt_init(void)
+{
+	struct rsdp *rsdp;
+	struct sdthdr *rsdt, *hdr;
+	struct madt *madt = NULL;
+	struct madtlapic *proc;
+	uint32_t *tab;
+	uint8_t *p, *e;
+	int i, n;
+
+	if ((rsdp = search_low("RSD PTR ", 8, 20)) == NULL)
+		return 0;
+	rsdt = firmware_map(rsdp->rsdt, sizeof(*rsdt));
+	if (memcmp(rsdt->signature, "RSDT", 4) != 0)
+		return 0;
+	rsdt = firmware_map(rsdp->rsdt, rsdt->length);
+	if (sum(rsdt, rsdt->length) != 0)
+		return 0;
+
+	tab = (uint32_t *) (rsdt + 1);
+	n = (rsdt->length - sizeof(*rsdt)) / 4;
+	for (i = 0; i < n && !madt; i++) {
+		hdr = firmware_map(tab[i], sizeof(*hdr));
+		if (memcmp(hdr->signature, "APIC", 4) == 0)
+			madt = firmware_map(tab[i], hdr->length);
+	}
+	if (!madt || sum(madt, madt->hdr.length) != 0)
+		return 0;
+
+	lapicaddr = madt->lapicaddr;
+	p = madt->entries;
+	e = (uint8_t *) madt + madt->hdr.length;
+	for (; p < e && p[1] > 0; p += p[1]) {
+		if (p[0] != MADT_LAPIC)
+			continue;
+		proc = (struct madtlapic *) p;
+		if (proc->flags & MADT_LAPIC_EN)
+			add_cpu(proc->apicid);
+	}
+	return 1;
+}
+
+// Find the CPUs through the MP configuration table.
+// Returns 1 on success.
+static int
+mpconf_init(void)
+{
+	struct mp *mp;
+	struct mpconf *conf;
+	struct mpproc *proc;
+	uint8_t *p;
+	unsigned int i;
+
+	if ((mp = search_low("_MP_", 4, sizeof(*mp))) == NULL)
+		return 0;
+	if (mp->physaddr == 0 || mp->type != 0) {
+		cprintf("SMP: Default configurations not implemented\n");
+		return 0;
+	}
+	conf = firmware_map(mp->physaddr, sizeof(*conf));
+	if (memcmp(conf, "PCMP", 4) != 0) {
+		cprintf("SMP: Incorrect MP configuration table signature\n");
+		return 0;
+	}
+	conf = firmware_map(mp->physaddr, conf->length);
+	if (sum(conf, conf->length) != 0) {
+		cprintf("SMP: Bad MP configuration checksum\n");
+		return 0;
+	}
+	if (conf->version != 1 && conf->version != 4) {
+		cprintf("SMP: Unsupported MP version %d\n", conf->version);
+		return 0;
+	}
+
+	lapicaddr = conf->lapicaddr;
+	for (p = conf->entries, i = 0; i < conf->entry; i++) {
+		switch (*p) {
+		case MPPROC:
+			proc = (struct mpproc *)p;
+			if (proc->flags & MPPROC_EN)
+				add_cpu(proc->apicid);
+			p += sizeof(struct mpproc);
+			continue;
+		case MPBUS:
+		case MPIOAPIC:
+		case MPIOINTR:
+		case MPLINTR:
+			p += 8;
+			continue;
+		default:
+			cprintf("SMP: Unknown config type %x\n", *p);
+			ncpu = 1;
+			return 0;
+		}
+	}
+
+	if (mp->imcrp) {
+		// [MP 3.2.6.1] If the hardware implements PIC mode,
+		// switch to getting interrupts from the LAPIC.
+		cprintf("SMP: Setting IMCR to switch from PIC mode to symmetric I/O mode\n");
+		outb(0x22, 0x70);   // Select IMCR
+		outb(0x23, inb(0x23) | 1);  // Mask external interrupts.
+	}
+	return 1;
+}
+
+void
+mp_init(void)
+{
+	uint32_t ebx;
+	const char *source;
+
+	// We are the boot processor; CPUID says which local APIC is ours.
+	cpuid(1, NULL, &ebx, NULL, NULL);
+	bootcpu = &cpus[0];
+	bootcpu->cpu_apicid = ebx >> 24;
+	bootcpu->cpu_status = CPU_STARTED;
+	ncpu = 1;
+
+	if (madt_init())
+		source = "ACPI";
+	else if (mpconf_init())
+		source = "MP";
+	else {
+		// Didn't find any CPUs; just run one.
+		lapicaddr = 0;
+		cprintf("SMP: no ACPI or MP tables, using one CPU\n");
+		return;
+	}
+	ismp = 1;
+
+	cprintf("SMP: CPU %d found %d CPU(s) (%s tables)\n",
+		bootcpu->cpu_id, ncpu, source);
+}
@@ -0,0 +1,415 @@
+/* See COPYRIGHT for copyright information. */
+
+#include <inc/x86.h>
+#include <inc/mmu.h>
+#include <inc/error.h>
+#include <inc/string.h>
+#include <inc/assert.h>
+#include <inc/bootinfo.h>
+#include <inc/multiboot.h>
+
+#include <kern/pmap.h>
+#include <kern/kclock.h>
+#include <kern/cpu.h>
+#include <kern/spinlock.h>
+
+// These variables are set by i386_detect_memory()
+static physaddr_t maxpa;	// Maximum physical address
+size_t npage;			// Amount of physical memory (in pages)
+
+// The physical memory map, from whichever source the boot path offers
+static struct Memrange mem_map[BI_MAXMMAP];
+static int nmem_map;
+
+// These variables are set in page_init()
+static char *boot_freemem;	// Pointer to next byte of free mem
+struct Page *pages;		// Virtual address of physical page array
+static struct Page_list page_free_list;	// Free list of physical pages
+static struct spinlock page_lock = SPINLOCK_INITIALIZER(page_lock);	// Protects page_free_list
+
+// Boot information always lies in low memory, but npage is not yet
+// known when it is read, so KADDR cannot be used on it.
+#define BOOTPTR(pa)	((void *) (KERNBASE + (physaddr_t) (pa)))
+
+static const char *mem_type[] = {
+	[MR_USABLE]	= "usable",
+	[MR_RESERVED]	= "reserved",
+	[MR_ACPI]	= "ACPI data",
+	[MR_NVS]	= "ACPI NVS",
+	[MR_BAD]	= "bad",
+};
+
+static int
+nvram_read(int r)
+{
+	return mc146818_read(r) | (mc146818_read(r + 1) << 8);
+}
+
+static void
+mem_map_add(uint64_t base, uint64_t len, uint32_t type)
+{
+	if (len == 0)
+		return;
+	if (nmem_map == BI_MAXMMAP) {
+		warn("memory map: too many ranges, ignoring %016llx", base);
+		return;
+	}
+	mem_map[nmem_map].mr_base = base;
+	mem_map[nmem_map].mr_len = len;
+	mem_map[nmem_map].mr_type = type;
+	mem_map[nmem_map].mr_attr = MR_ATTR_VALID;
+	nmem_map++;
+}
+
+// Build the physical memory map from what the boot path handed to
+// i386_init: the BIOS E820 map our boot loader collected, a Multiboot
+// memory map (or at least its memory sizes), or, failing both, the
+// base and extended memory sizes the BIOS keeps in CMOS NVRAM.
+// Sets maxpa and npage to cover all usable memory the kernel can
+// address.
+void
+i386_detect_memory(uint32_t boot_magic, physaddr_t boot_info)
+{
+	struct Bootinfo *bi;
+	struct Multiboot_info *mbi;
+	struct Multiboot_mmap *mm;
+	const char *source = NULL;
+	uint64_t top = 0, usable = 0;
+	uint32_t off;
+	int i;
+
+	if (boot_magic == JOS_BOOT_MAGIC) {
+		bi = BOOTPTR(boot_info);
+		if (bi->bi_flags & BI_MMAP) {
+			source = "e820";
+			// The boot loader sets mr_attr to MR_ATTR_VALID
+			// when the BIOS returns only 20 bytes, so this
+			// skips just the entries ACPI 3.0 says to ignore.
+			for (i = 0; i < bi->bi_nmmap && i < BI_MAXMMAP; i++)
+				if (bi->bi_mmap[i].mr_attr & MR_ATTR_VALID)
+					mem_map_add(bi->bi_mmap[i].mr_base,
+						    bi->bi_mmap[i].mr_len,
+						    bi->bi_mmap[i].mr_type);
+		}
+	} else if (boot_magic == MULTIBOOT_BOOTLOADER_MAGIC) {
+		mbi = BOOTPTR(boot_info);
+		if (mbi->mb_flags & MB_INFO_MMAP) {
+			source = "multiboot";
+			for (off = 0; off < mbi->mb_mmap_length;
+			     off += mm->mm_size + sizeof(mm->mm_size)) {
+				mm = BOOTPTR(mbi->mb_mmap_addr + off);
+				mem_map_add(mm->mm_base, mm->mm_len, mm->mm_type);
+			}
+		} else if (mbi->mb_flags & MB_INFO_MEMORY) {
+			source = "multiboot";
+			mem_map_add(0, mbi->mb_mem_lower * 1024ULL, MR_USABLE);
+			mem_map_add(EXTPHYSMEM, mbi->mb_mem_upper * 1024ULL,
+				    MR_USABLE);
+		}
+	}
+
+	if (nmem_map == 0) {
+		source = "nvram";
+		mem_map_add(0, nvram_read(NVRAM_BASELO) * 1024ULL, MR_USABLE);
+		mem_map_add(EXTPHYSMEM, nvram_read(NVRAM_EXTLO) * 1024ULL,
+			    MR_USABLE);
+	}
+
+	cprintf("Physical memory map (%s):\n", source);
+	for (i = 0; i < nmem_map; i++) {
+		struct Memrange *mr = &mem_map[i];
+
+		cprintf("  %016llx-%016llx %s\n", mr->mr_base,
+			mr->mr_base + mr->mr_len - 1,
+			mr->mr_type < sizeof(mem_type) / sizeof(mem_type[0])
+			&& mem_type[mr->mr_type] ? mem_type[mr->mr_type]
+			: "unknown");
+		if (mr->mr_type != MR_USABLE)
+			continue;
+		usable += mr->mr_len;
+		top = MAX(top, mr->mr_base + mr->mr_len);
+	}
+
+	maxpa = ROUNDDOWN(MIN(top, (uint64_t) MAXPA), PGSIZE);
+	npage = maxpa / PGSIZE;
+
+	cprintf("Physical memory: %lluK usable, %uK addressable\n",
+		usable / 1024, maxpa / 1024);
+}
+
+// Allocate n bytes of physical memory aligned on an
+// align-byte boundary.  Align must be a power of two.
+// Return kernel virtual address.  Returned memory is uninitialized.
+//
+// If we're out of memory, boot_alloc should panic.
+// It's too early to run out of memory.
+// This function may ONLY be used during initialization,
+// before the page_free_list has been set up.
+static void*
+boot_alloc(uint32_t n, uint32_t align)
+{
+	extern char end[];
+	void *v;
+
+	// Initialize boot_freemem if this is the first time.
+	// 'end' is a magic symbol automatically generated by the linker,
+	// which points to the end of the kernel's bss segment -
+	// i.e., the first virtual address that the linker
+	// did _not_ assign to any kernel code or global variables.
+	if (boot_freemem == 0)
+		boot_freemem = end;
+
+	boot_freemem = ROUNDUP(boot_freemem, align);
+	v = boot_freemem;
+	boot_freemem += n;
+	if (PADDR(boot_freemem) > maxpa)
+		panic("boot_alloc: out of memory");
+	return v;
+}
+
+// Set the pp_ref of pages [lo, hi) (physical addresses, clipped
+// to maxpa) to ref.
+static void
+page_mark(uint64_t lo, uint64_t hi, uint16_t ref)
+{
+	ppn_t pn;
+
+	hi = MIN(hi, (uint64_t) maxpa);
+	for (pn = lo >> PGSHIFT; pn < (hi >> PGSHIFT); pn++)
+		pages[pn].pp_ref = ref;
+}
+
+//
+// Initialize the pages array and the page_free_list from the
+// memory map.  A page is free if it lies wholly inside a usable
+// range and no other range touches it, except for:
+//  - physical page 0, the real-mode IDT and BIOS structures;
+//  - the page at MPENTRY_PADDR, where APs start (kern/mpentry.S);
+//  - the IO hole [IOPHYSMEM, EXTPHYSMEM);
+//  - the kernel, and everything boot_alloc has handed out.
+// Pages in use have pp_ref 1; free pages have pp_ref 0.
+//
+void
+page_init(void)
+{
+	uint64_t base, lim;
+	ppn_t pn;
+	int i;
+
+	pages = boot_alloc(npage * sizeof(struct Page), PGSIZE);
+	memset(pages, 0, npage * sizeof(struct Page));
+
+	// Free the usable ranges, rounded inward, then take back
+	// whatever any other range touches, rounded outward.
+	page_mark(0, maxpa, 1);
+	for (i = 0; i < nmem_map; i++) {
+		if (mem_map[i].mr_type != MR_USABLE)
+			continue;
+		base = mem_map[i].mr_base;
+		lim = base + mem_map[i].mr_len;
+		page_mark((base + PGSIZE - 1) & ~(uint64_t) (PGSIZE - 1),
+			  lim & ~(uint64_t) (PGSIZE - 1), 0);
+	}
+	for (i = 0; i < nmem_map; i++) {
+		if (mem_map[i].mr_type == MR_USABLE)
+			continue;
+		base = mem_map[i].mr_base;
+		lim = base + mem_map[i].mr_len;
+		page_mark(base & ~(uint64_t) (PGSIZE - 1),
+			  (lim + PGSIZE - 1) & ~(uint64_t) (PGSIZE - 1), 1);
+	}
+	page_mark(0, PGSIZE, 1);
+	page_mark(MPENTRY_PADDR, MPENTRY_PADDR + PGSIZE, 1);
+	page_mark(IOPHYSMEM, ROUNDUP(PADDR(boot_freemem), PGSIZE), 1);
+
+	LIST_INIT(&page_free_list);
+	for (pn = 0; pn < npage; pn++)
+		if (pages[pn].pp_ref == 0)
+			LIST_INSERT_HEAD(&page_free_list, &pages[pn], pp_link);
+}
+
+//
+// Initialize a Page structure.
+// The result has null links and 0 refcount.
+// Note that the corresponding physical page is NOT initialized!
+//
+static void
+page_initpp(struct Page *pp)
+{
+	memset(pp, 0, sizeof(*pp));
+}
+
+//
+// Allocates a physical page.
+// Does NOT set the contents of the physical page to zero -
+// the caller must do that if necessary.
+//
+// *pp_store -- is set to point to the Page struct of the newly allocated
+// page
+//
+// RETURNS
+//   0 -- on success
+//   -E_NO_MEM -- otherwise
+//
+int
+page_alloc(struct Page **pp_store)
+{
+	struct Page *pp;
+
+	spin_lock(&page_lock);
+	if ((pp = LIST_FIRST(&page_free_list)) == NULL) {
+		spin_unlock(&page_lock);
+		return -E_NO_MEM;
+	}
+	LIST_REMOVE(pp, pp_link);
+	spin_unlock(&page_lock);
+	page_initpp(pp);
+	*pp_store = pp;
+	return 0;
+}
+
+//
+// Return a page to the free list.
+// (This function should only be called when pp->pp_ref reaches 0.)
+//
+void
+page_free(struct Page *pp)
+{
+	if (pp->pp_ref)
+		panic("page_free: page %08x still referenced", page2pa(pp));
+	spin_lock(&page_lock);
+	LIST_INSERT_HEAD(&page_free_list, pp, pp_link);
+	spin_unlock(&page_lock);
+}
+
+//
+// Decrement the reference count on a page,
+// freeing it if there are no more refs.
+//
+void
+page_decref(struct Page *pp)
+{
+	if (--pp->pp_ref == 0)
+		page_free(pp);
+}
+
+// Given 'pgdir', a pointer to a page directory, pgdir_walk returns
+// a pointer to the page table entry (PTE) for linear address 'va'.
+// This requires walking the two-level page table structure.
+//
+// If the relevant page table doesn't exist in the page directory, then:
+//    - If create == 0, pgdir_walk returns NULL.
+//    - Otherwise, pgdir_walk tries to allocate a new page table
+//	with page_alloc.  If this fails, pgdir_walk returns NULL.
+//    - Otherwise, pgdir_walk returns a pointer into the new page table.
+//
+// 'va' must not lie in a 4MB (PTE_PS) mapping, which has no page table.
+//
+pte_t *
+pgdir_walk(pde_t *pgdir, const void *va, int create)
+{
+	pde_t *pde = &pgdir[PDX(va)];
+	struct Page *pp;
+
+	assert(!(*pde & PTE_PS));
+	if (!(*pde & PTE_P)) {
+		if (!create || page_alloc(&pp) < 0)
+			return NULL;
+		pp->pp_ref = 1;
+		memset(page2kva(pp), 0, PGSIZE);
+		*pde = page2pa(pp) | PTE_P | PTE_W;
+	}
+	return (pte_t *) KADDR(PTE_ADDR(*pde)) + PTX(va);
+}
+
+//
+// Map [la, la+size) of linear address space to physical [pa, pa+size)
+// in the page table rooted at pgdir, with 4KB pages.
+// Size is a multiple of PGSIZE.
+// Use permission bits perm|PTE_P for the entries.
+// Returns 0 on success, -E_NO_MEM if a page table could not be
+// allocated (mappings made so far are left in place).
+//
+int
+boot_map_segment(pde_t *pgdir, uintptr_t la, size_t size, physaddr_t pa, int perm)
+{
+	pte_t *pte;
+	size_t off;
+
+	for (off = 0; off < size; off += PGSIZE) {
+		if ((pte = pgdir_walk(pgdir, (void *) (la + off), 1)) == NULL)
+			return -E_NO_MEM;
+		*pte = (pa + off) | perm | PTE_P;
+	}
+	return 0;
+}
+
+//
+// Undo boot_map_segment: clear the page directory entries covering
+// [la, la+size), which must be PTSIZE-aligned, free their page tables,
+// and flush the TLB.
+//
+void
+boot_unmap_segment(pde_t *pgdir, uintptr_t la, size_t size)
+{
+	pde_t *pde;
+	size_t off;
+
+	assert(la % PTSIZE == 0 && size % PTSIZE == 0);
+	for (off = 0; off < size; off += PTSIZE) {
+		pde = &pgdir[PDX(la + off)];
+		if (!(*pde & PTE_P))
+			continue;
+		assert(!(*pde & PTE_PS));
+		page_decref(pa2page(PTE_ADDR(*pde)));
+		*pde = 0;
+	}
+	lcr3(rcr3());
+}
+
+//
+// Map each CPU's kernel stack (percpu_kstacks[i]) at
+// KSTACKTOP - i * (KSTKSIZE + KSTKGAP), leaving the KSTKGAP
+// below each one unmapped as a guard against overflow.
+//
+void
+mem_init_mp(void)
+{
+	uintptr_t kstacktop_i;
+	int i;
+
+	for (i = 0; i < NCPU; i++) {
+		kstacktop_i = KSTACKTOP - i * (KSTKSIZE + KSTKGAP);
+		if (boot_map_segment(boot_pgdir, kstacktop_i - KSTKSIZE,
+				     KSTKSIZE, PADDR(percpu_kstacks[i]),
+				     PTE_W) < 0)
+			panic("mem_init_mp: out of memory");
+	}
+}
+
+//
+// Reserve size bytes in the MMIO region and map [pa,pa+size) at this
+// location, uncached.  Return the virtual address corresponding to pa.
+// pa and size need not be page-aligned.
+//
+void *
+mmio_map_region(physaddr_t pa, size_t size)
+{
+	// Where to start the next region.  Initially, this is the
+	// beginning of the MMIO region.  Because this is static, its
+	// value will be preserved between calls to mmio_map_region
+	// (just like boot_freemem for boot_alloc).
+	static uintptr_t base = MMIOBASE;
+	physaddr_t start = ROUNDDOWN(pa, PGSIZE);
+	uintptr_t va;
+
+	size = ROUNDUP(pa + size, PGSIZE) - start;
+	if (base + size > MMIOLIM)
+		panic("mmio_map_region: out of MMIO space");
+	if (boot_map_segment(boot_pgdir, base, size, start,
+			     PTE_W | PTE_PCD | PTE_PWT) < 0)
+		panic("mmio_map_region: out of memory");
+	va = base + (pa - start);
+	base += size;
+	return (void *) va;
+}
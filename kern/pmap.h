@@ -0,0 +1,85 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_PMAP_H
+#define JOS_KERN_PMAP_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/memlayout.h>
+#include <inc/assert.h>
+
+// Highest physical address the kernel can reach through its
+// KERNBASE window (256MB); memory above it is left unused.
+#define MAXPA		((physaddr_t) -KERNBASE)
+
+/* This macro takes a kernel virtual address -- an address that points above
+ * KERNBASE, where the machine's maximum 256MB of physical memory is mapped --
+ * and returns the corresponding physical address.  It panics if you pass it a
+ * non-kernel virtual address.
+ */
+#define PADDR(kva)						\
+({								\
+	physaddr_t __m_kva = (physaddr_t) (kva);		\
+	if (__m_kva < KERNBASE)					\
+		panic("PADDR called with invalid kva %08lx", __m_kva);\
+	__m_kva - KERNBASE;					\
+})
+
+/* This macro takes a physical address and returns the corresponding kernel
+ * virtual address.  It panics if you pass an invalid physical address. */
+#define KADDR(pa)						\
+({								\
+	physaddr_t __m_pa = (pa);				\
+	uint32_t __m_ppn = PPN(__m_pa);				\
+	if (__m_ppn >= npage)					\
+		panic("KADDR called with invalid pa %08lx", __m_pa);\
+	(void*) (__m_pa + KERNBASE);				\
+})
+
+
+extern struct Page *pages;
+extern size_t npage;
+
+extern pde_t boot_pgdir[];	// kern/entry.S
+
+void	i386_detect_memory(uint32_t boot_magic, physaddr_t boot_info);
+void	page_init(void);
+int	page_alloc(struct Page **pp_store);
+void	page_free(struct Page *pp);
+void	page_decref(struct Page *pp);
+
+pte_t	*pgdir_walk(pde_t *pgdir, const void *va, int create);
+int	boot_map_segment(pde_t *pgdir, uintptr_t la, size_t size,
+			 physaddr_t pa, int perm);
+void	boot_unmap_segment(pde_t *pgdir, uintptr_t la, size_t size);
+void	mem_init_mp(void);
+void	*mmio_map_region(physaddr_t pa, size_t size);
+
+static inline ppn_t
+page2ppn(struct Page *pp)
+{
+	return pp - pages;
+}
+
+static inline physaddr_t
+page2pa(struct Page *pp)
+{
+	return page2ppn(pp) << PGSHIFT;
+}
+
+static inline struct Page*
+pa2page(physaddr_t pa)
+{
+	if (PPN(pa) >= npage)
+		panic("pa2page called with invalid pa");
+	return &pages[PPN(pa)];
+}
+
+static inline void*
+page2kva(struct Page *pp)
+{
+	return KADDR(page2pa(pp));
+}
+
+#endif /* !JOS_KERN_PMAP_H */
@@ -1,25 +1,178 @@
 // Simple implementation of cprintf console output for the kernel,
-// based on printfmt() and the kernel console's cputchar().
+// based on vspanfmt() and the kernel console's cons_write().
+//
+// Once the console is up, cprintf does not touch the console devices:
+// each CPU appends its output to its own ring, and whichever CPU next
+// runs cons_drain() (an idle CPU, or one waiting for console input)
+// copies the rings out to the devices.  Each ring has one producer,
+// its CPU, and one consumer, the drainer, so neither side locks.  A
+// cprintf call is published as a unit, so CPUs do not interleave
+// within one another's lines.
 
 #include <inc/types.h>
 #include <inc/stdio.h>
 #include <inc/stdarg.h>
+#include <inc/string.h>
+#include <inc/x86.h>
+#include <inc/mmu.h>
 
+#include <kern/console.h>
+#include <kern/cpu.h>
 
+#define CONSRING_SIZE	4096	// must be a power of 2
+#define PRINTBUF_SIZE	128	// vcprintf's on-stack staging buffer
+
+struct consring {
+	volatile uint32_t head;		// written only by the owning CPU
+	volatile uint32_t tail		// written only by the drainer
+		__attribute__((aligned(CACHELINE)));
+	char buf[CONSRING_SIZE];
+} __attribute__((aligned(CACHELINE)));
+
+static struct consring consring[NCPU];
+
+// Nonzero once output goes through the rings; cleared again by
+// cons_sync().  Until cons_init, %gs may not yet be set up.
+static volatile int cons_async;
+static volatile uint32_t cons_draining;	// a CPU is in cons_drain()
+
+struct printbuf {
+	struct consring *ring;		// NULL when writing synchronously
+	uint32_t head;			// not yet published
+	int cnt;
+	int n;				// bytes staged in buf
+	char buf[PRINTBUF_SIZE];
+};
+
+static void
+drain_ring(struct consring *r)
+{
+	uint32_t tail = r->tail, head = r->head, off, n;
+
+	// At most two contiguous spans, either side of the wrap point
+	while (tail != head) {
+		off = tail & (CONSRING_SIZE - 1);
+		n = MIN(head - tail, CONSRING_SIZE - off);
+		cons_write(r->buf + off, n);
+		tail += n;
+	}
+	r->tail = tail;
+}
+
+// Copy every CPU's buffered output to the console devices.
+// Returns at once if another CPU is already draining.
+void
+cons_drain(void)
+{
+	int i;
+
+	for (i = 0; i < NCPU; i++)
+		if (consring[i].head != consring[i].tail)
+			break;
+	if (i == NCPU || xchg(&cons_draining, 1) != 0)
+		return;
+	for (i = 0; i < NCPU; i++)
+		drain_ring(&consring[i]);
+	cons_draining = 0;
+}
+
+// Flush what the rings hold and write all further output straight
+// to the devices.  For panic, when there may be nobody left to drain;
+// this does not wait for a drainer on another CPU.
+void
+cons_sync(void)
+{
+	int i;
+
+	cons_async = 0;
+	for (i = 0; i < NCPU; i++)
+		drain_ring(&consring[i]);
+	cons_flush();
+}
+
+// Start buffering cprintf output.  Called by cons_init.
+void
+cons_startasync(void)
+{
+	cons_async = 1;
+}
+
+// Move the staged bytes to the console, or into this CPU's ring
+// (not yet published).
 static void
-putch(int ch, int *cnt)
+flush(struct printbuf *b)
 {
-	cputchar(ch);
-	*cnt++;
+	struct consring *r = b->ring;
+	uint32_t off, n;
+	char *s = b->buf;
+
+	if (r == NULL) {
+		cons_write(b->buf, b->n);
+		cons_flush();
+		b->n = 0;
+		return;
+	}
+	while (b->n > 0) {
+		// If the ring is full, publish what we have and drain
+		// it ourselves, or wait for whoever is draining.
+		while (b->head - r->tail == CONSRING_SIZE) {
+			r->head = b->head;
+			cons_drain();
+			pause();
+		}
+		off = b->head & (CONSRING_SIZE - 1);
+		n = MIN(MIN((uint32_t) b->n, CONSRING_SIZE - off),
+			CONSRING_SIZE - (b->head - r->tail));
+		memcpy(r->buf + off, s, n);
+		b->head += n;
+		s += n;
+		b->n -= n;
+	}
+}
+
+static void
+putspan(const char *s, int n, struct printbuf *b)
+{
+	int m;
+
+	b->cnt += n;
+	for (; n > 0; n -= m, s += m) {
+		if (b->n == PRINTBUF_SIZE)
+			flush(b);
+		m = MIN(n, PRINTBUF_SIZE - b->n);
+		memcpy(b->buf + b->n, s, m);
+		b->n += m;
+	}
 }
 
 int
 vcprintf(const char *fmt, va_list ap)
 {
-	int cnt = 0;
+	struct printbuf b;
+	uint32_t eflags;
 
-	vprintfmt((void*)putch, &cnt, fmt, ap);
-	return cnt;
+	b.cnt = 0;
+	b.n = 0;
+	if (!cons_async) {
+		b.ring = NULL;
+		vspanfmt((void*)putspan, &b, fmt, ap);
+		flush(&b);
+		return b.cnt;
+	}
+
+	// An interrupt handler on this CPU must not print into the
+	// middle of our record.
+	eflags = read_eflags();
+	cli();
+	b.ring = &consring[cpunum()];
+	b.head = b.ring->head;
+	vspanfmt((void*)putspan, &b, fmt, ap);
+	flush(&b);
+	__asm __volatile("" : : : "memory");
+	b.ring->head = b.head;
+	if (eflags & FL_IF)
+		sti();
+	return b.cnt;
 }
 
 int
@@ -0,0 +1,55 @@
+#include <inc/assert.h>
+#include <inc/error.h>
+#include <inc/x86.h>
+
+#include <kern/cpu.h>
+#include <kern/console.h>
+#include <kern/klog.h>
+#include <kern/sched.h>
+
+// The idle loop each application processor parks in once it is up.
+// There are no environments to schedule yet, so the only work an
+// idle CPU picks up is a function handed to it by sched_call(), and
+// writing out other CPUs' buffered console output.
+void
+sched_idle(void)
+{
+	struct CpuInfo *c = thiscpu;
+	void (*fn)(void *);
+
+	while (1) {
+		while ((fn = c->cpu_fn) == NULL) {
+			cons_drain();
+			pause();
+		}
+		fn(c->cpu_arg);
+		percpu_inc(PCPU_SCHED_CALLS);
+		c->cpu_fn = NULL;
+	}
+}
+
+// Have idle CPU 'cpu' run fn(arg), without waiting for it to finish.
+// Only one CPU at a time may hand work to a given CPU.
+// Returns -E_INVAL if 'cpu' is not another CPU that has started.
+int
+sched_call(int cpu, void (*fn)(void *), void *arg)
+{
+	struct CpuInfo *c = &cpus[cpu];
+
+	if (cpu < 0 || cpu >= ncpu || c == thiscpu
+	    || c->cpu_status != CPU_STARTED)
+		return -E_INVAL;
+	sched_wait(cpu);
+	klog("sched_call: CPU %d runs %p(%p)\n", cpu, fn, arg);
+	c->cpu_arg = arg;
+	c->cpu_fn = fn;
+	return 0;
+}
+
+// Wait for the work last handed to CPU 'cpu' to finish.
+void
+sched_wait(int cpu)
+{
+	while (cpus[cpu].cpu_fn != NULL)
+		pause();
+}
@@ -0,0 +1,15 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_SCHED_H
+#define JOS_KERN_SCHED_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+// This function does not return.
+void sched_idle(void) __attribute__((noreturn));
+
+int sched_call(int cpu, void (*fn)(void *), void *arg);
+void sched_wait(int cpu);
+
+#endif	// !JOS_KERN_SCHED_H
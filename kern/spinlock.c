@@ -0,0 +1,244 @@
+// Mutual exclusion spin locks: ticket locks and MCS queue locks.
+
+#include <inc/types.h>
+#include <inc/assert.h>
+#include <inc/x86.h>
+#include <inc/memlayout.h>
+#include <inc/string.h>
+#include <kern/cpu.h>
+#include <kern/spinlock.h>
+#include <kern/kdebug.h>
+
+// Pause iterations per waiter ahead of us in a ticket lock's line
+#define TICKET_BACKOFF	16
+
+#ifdef DEBUG_SPINLOCK
+// Record the current call stack in pcs[] by following the %ebp chain.
+static void
+get_caller_pcs(uintptr_t pcs[])
+{
+	uint32_t *ebp;
+	int i;
+
+	ebp = (uint32_t *)read_ebp();
+	for (i = 0; i < 10; i++){
+		if (ebp == 0 || ebp < (uint32_t *)ULIM)
+			break;
+		pcs[i] = ebp[1];          // saved %eip
+		ebp = (uint32_t *)ebp[0]; // saved %ebp
+	}
+	for (; i < 10; i++)
+		pcs[i] = 0;
+}
+
+static void
+owner_set(struct lockowner *o)
+{
+	o->cpu = thiscpu;
+	get_caller_pcs(o->pcs);
+}
+
+static void
+owner_clear(struct lockowner *o)
+{
+	o->pcs[0] = 0;
+	o->cpu = 0;
+}
+
+// Report who holds the lock and where it was acquired, and panic.
+static void
+owner_panic(struct lockowner *o, const char *what)
+{
+	uintptr_t pcs[10];
+	struct CpuInfo *cpu = o->cpu;
+	int i;
+
+	// Nab the acquiring EIP chain before it gets released
+	memmove(pcs, o->pcs, sizeof pcs);
+	cprintf("CPU %d cannot %s %s: held by CPU %d.\nAcquired at:",
+		cpunum(), what, o->name, cpu ? cpu->cpu_id : -1);
+	for (i = 0; i < 10 && pcs[i]; i++) {
+		struct Eipdebuginfo info;
+		if (debuginfo_eip(pcs[i], &info) >= 0)
+			cprintf("  %08x %s:%d: %.*s+%x\n", pcs[i],
+				info.eip_file, info.eip_line,
+				info.eip_fn_namelen, info.eip_fn_name,
+				pcs[i] - info.eip_fn_addr);
+		else
+			cprintf("  %08x\n", pcs[i]);
+	}
+	panic("spinlock: %s %s", what, o->name);
+}
+
+// Check whether this CPU is holding the lock.
+static int
+spin_holding(struct spinlock *lk)
+{
+	return lk->next != lk->serving && lk->owner.cpu == thiscpu;
+}
+
+static int
+mcs_holding(struct mcslock *lk)
+{
+	return lk->tail != NULL && lk->owner.cpu == thiscpu;
+}
+#endif
+
+void
+spin_initlock(struct spinlock *lk, const char *name)
+{
+	lk->next = 0;
+	lk->serving = 0;
+#ifdef DEBUG_SPINLOCK
+	lk->owner.name = name;
+	owner_clear(&lk->owner);
+#endif
+}
+
+// Acquire the lock.
+// Loops (spins) until the lock is acquired.
+// Holding a lock for a long time may cause
+// other CPUs to waste time spinning to acquire it.
+void
+spin_lock(struct spinlock *lk)
+{
+	uint32_t ticket, ahead;
+
+#ifdef DEBUG_SPINLOCK
+	if (spin_holding(lk))
+		owner_panic(&lk->owner, "re-acquire");
+#endif
+
+	// Take a ticket, then wait for it to be served.  Back off in
+	// proportion to the number of CPUs ahead of us, so that waiters
+	// do not all keep pulling the lock's cache line away from the
+	// holder.
+	ticket = xadd(&lk->next, 1);
+	while ((ahead = ticket - lk->serving) != 0)
+		for (ahead *= TICKET_BACKOFF; ahead > 0; ahead--)
+			pause();
+
+#ifdef DEBUG_SPINLOCK
+	owner_set(&lk->owner);
+#endif
+}
+
+// Release the lock.
+void
+spin_unlock(struct spinlock *lk)
+{
+#ifdef DEBUG_SPINLOCK
+	if (!spin_holding(lk))
+		owner_panic(&lk->owner, "release");
+	owner_clear(&lk->owner);
+#endif
+
+	// Only the holder writes 'serving', and x86 does not reorder a
+	// store with earlier loads or stores, so a plain store releases
+	// the lock.  The barrier keeps the compiler from moving the
+	// critical section below it.
+	__asm __volatile("" : : : "memory");
+	lk->serving = lk->serving + 1;
+}
+
+// Disable interrupts on this CPU and acquire the lock.  Returns the
+// previous %eflags, for spin_unlock_irqrestore.
+uint32_t
+spin_lock_irqsave(struct spinlock *lk)
+{
+	uint32_t eflags = read_eflags();
+
+	cli();
+	spin_lock(lk);
+	return eflags;
+}
+
+void
+spin_unlock_irqrestore(struct spinlock *lk, uint32_t eflags)
+{
+	spin_unlock(lk);
+	if (eflags & FL_IF)
+		sti();
+}
+
+void
+mcs_initlock(struct mcslock *lk, const char *name)
+{
+	lk->tail = NULL;
+#ifdef DEBUG_SPINLOCK
+	lk->owner.name = name;
+	owner_clear(&lk->owner);
+#endif
+}
+
+// Acquire the lock, queueing 'me' (which must stay put until the
+// matching mcs_unlock) behind any other waiters.
+void
+mcs_lock(struct mcslock *lk, struct mcsnode *me)
+{
+	struct mcsnode *prev;
+
+#ifdef DEBUG_SPINLOCK
+	if (mcs_holding(lk))
+		owner_panic(&lk->owner, "re-acquire");
+#endif
+
+	me->next = NULL;
+	me->locked = 1;
+	prev = (struct mcsnode *) xchg((volatile uint32_t *) &lk->tail,
+				       (uint32_t) me);
+	if (prev) {
+		// Link in behind our predecessor and spin on our own node
+		// until it hands the lock over.
+		prev->next = me;
+		while (me->locked)
+			pause();
+	}
+
+#ifdef DEBUG_SPINLOCK
+	owner_set(&lk->owner);
+#endif
+}
+
+// Release the lock to the next waiter, if any.
+void
+mcs_unlock(struct mcslock *lk, struct mcsnode *me)
+{
+	struct mcsnode *next;
+
+#ifdef DEBUG_SPINLOCK
+	if (!mcs_holding(lk))
+		owner_panic(&lk->owner, "release");
+	owner_clear(&lk->owner);
+#endif
+
+	if ((next = me->next) == NULL) {
+		// No successor yet.  If we are still the tail, the lock
+		// is now free; otherwise one is linking itself in.
+		if (cmpxchg((volatile uint32_t *) &lk->tail,
+			    (uint32_t) me, 0) == (uint32_t) me)
+			return;
+		while ((next = me->next) == NULL)
+			pause();
+	}
+	__asm __volatile("" : : : "memory");
+	next->locked = 0;
+}
+
+uint32_t
+mcs_lock_irqsave(struct mcslock *lk, struct mcsnode *me)
+{
+	uint32_t eflags = read_eflags();
+
+	cli();
+	mcs_lock(lk, me);
+	return eflags;
+}
+
+void
+mcs_unlock_irqrestore(struct mcslock *lk, struct mcsnode *me, uint32_t eflags)
+{
+	mcs_unlock(lk, me);
+	if (eflags & FL_IF)
+		sti();
+}
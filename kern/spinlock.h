@@ -0,0 +1,65 @@
+#ifndef JOS_KERN_SPINLOCK_H
+#define JOS_KERN_SPINLOCK_H
+
+#include <inc/types.h>
+
+// Spinlock debugging (owner tracking, and checks for recursive or
+// foreign unlocks) is on when the kernel is built with
+// 'make DEBUG_SPINLOCK=1'.
+
+// Debug information about a lock's current holder.
+struct lockowner {
+	const char *name;		// Name of lock.
+	struct CpuInfo *cpu;		// The CPU holding the lock.
+	uintptr_t pcs[10];		// The call stack (an array of program
+					// counters) that locked the lock.
+};
+
+// Ticket spinlock, for short critical sections.  CPUs take a ticket
+// and are served strictly in order, so no CPU starves; each waiter
+// backs off in proportion to its distance from the head of the line.
+struct spinlock {
+	volatile uint32_t next;		// Next ticket to hand out
+	volatile uint32_t serving;	// Ticket now holding the lock
+#ifdef DEBUG_SPINLOCK
+	struct lockowner owner;
+#endif
+};
+
+// MCS queue lock, for contended critical sections.  Each waiter
+// spins on its own mcsnode rather than on the lock, so a release
+// touches only the next waiter's cache line.
+struct mcsnode {
+	struct mcsnode *volatile next;
+	volatile uint32_t locked;
+} __attribute__((aligned(64)));
+
+struct mcslock {
+	struct mcsnode *volatile tail;	// Last waiter, or NULL if free
+#ifdef DEBUG_SPINLOCK
+	struct lockowner owner;
+#endif
+};
+
+#ifdef DEBUG_SPINLOCK
+#define SPINLOCK_INITIALIZER(nam)	{ 0, 0, { #nam, 0, { 0 } } }
+#define MCSLOCK_INITIALIZER(nam)	{ 0, { #nam, 0, { 0 } } }
+#else
+#define SPINLOCK_INITIALIZER(nam)	{ 0, 0 }
+#define MCSLOCK_INITIALIZER(nam)	{ 0 }
+#endif
+
+void spin_initlock(struct spinlock *lk, const char *name);
+void spin_lock(struct spinlock *lk);
+void spin_unlock(struct spinlock *lk);
+uint32_t spin_lock_irqsave(struct spinlock *lk);
+void spin_unlock_irqrestore(struct spinlock *lk, uint32_t eflags);
+
+void mcs_initlock(struct mcslock *lk, const char *name);
+void mcs_lock(struct mcslock *lk, struct mcsnode *me);
+void mcs_unlock(struct mcslock *lk, struct mcsnode *me);
+uint32_t mcs_lock_irqsave(struct mcslock *lk, struct mcsnode *me);
+void mcs_unlock_irqrestore(struct mcslock *lk, struct mcsnode *me,
+			   uint32_t eflags);
+
+#endif
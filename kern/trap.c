@@ -0,0 +1,208 @@
+#include <inc/mmu.h>
+#include <inc/x86.h>
+#include <inc/assert.h>
+
+#include <kern/trap.h>
+#include <kern/cpu.h>
+#include <kern/console.h>
+#include <kern/picirq.h>
+
+// Interrupt descriptor table.  (Must be built at run time because
+// shifted function addresses can't be represented in relocation records.)
+struct Gatedesc idt[256] = { { 0 } };
+struct Pseudodesc idt_pd = {
+	sizeof(idt) - 1, (uint32_t) idt
+};
+
+
+static const char *trapname(int trapno)
+{
+	static const char * const excnames[] = {
+		"Divide error",
+		"Debug",
+		"Non-Maskable Interrupt",
+		"Breakpoint",
+		"Overflow",
+		"BOUND Range Exceeded",
+		"Invalid Opcode",
+		"Device Not Available",
+		"Double Fault",
+		"Coprocessor Segment Overrun",
+		"Invalid TSS",
+		"Segment Not Present",
+		"Stack Fault",
+		"General Protection",
+		"Page Fault",
+		"(unknown trap)",
+		"x87 FPU Floating-Point Error",
+		"Alignment Check",
+		"Machine-Check",
+		"SIMD Floating-Point Exception"
+	};
+
+	if (trapno < sizeof(excnames)/sizeof(excnames[0]))
+		return excnames[trapno];
+	if (trapno >= IRQ_OFFSET && trapno < IRQ_OFFSET + 16)
+		return "Hardware Interrupt";
+	return "(unknown trap)";
+}
+
+
+void
+trap_init(void)
+{
+	extern void t_divide(), t_debug(), t_nmi(), t_brkpt(), t_oflow(),
+		t_bound(), t_illop(), t_device(), t_dblflt(), t_tss(),
+		t_segnp(), t_stack(), t_gpflt(), t_pgflt(), t_fperr(),
+		t_align(), t_mchk(), t_simderr();
+	extern void irq_0(), irq_1(), irq_2(), irq_3(), irq_4(), irq_5(),
+		irq_6(), irq_7(), irq_8(), irq_9(), irq_10(), irq_11(),
+		irq_12(), irq_13(), irq_14(), irq_15();
+	extern void t_lapic_spurious();
+	static void (*const irqs[16])() = {
+		irq_0, irq_1, irq_2, irq_3, irq_4, irq_5, irq_6, irq_7,
+		irq_8, irq_9, irq_10, irq_11, irq_12, irq_13, irq_14, irq_15
+	};
+	int i;
+
+	SETGATE(idt[T_DIVIDE], 0, GD_KT, t_divide, 0);
+	SETGATE(idt[T_DEBUG], 0, GD_KT, t_debug, 0);
+	SETGATE(idt[T_NMI], 0, GD_KT, t_nmi, 0);
+	SETGATE(idt[T_BRKPT], 0, GD_KT, t_brkpt, 0);
+	SETGATE(idt[T_OFLOW], 0, GD_KT, t_oflow, 0);
+	SETGATE(idt[T_BOUND], 0, GD_KT, t_bound, 0);
+	SETGATE(idt[T_ILLOP], 0, GD_KT, t_illop, 0);
+	SETGATE(idt[T_DEVICE], 0, GD_KT, t_device, 0);
+	SETGATE(idt[T_DBLFLT], 0, GD_KT, t_dblflt, 0);
+	SETGATE(idt[T_TSS], 0, GD_KT, t_tss, 0);
+	SETGATE(idt[T_SEGNP], 0, GD_KT, t_segnp, 0);
+	SETGATE(idt[T_STACK], 0, GD_KT, t_stack, 0);
+	SETGATE(idt[T_GPFLT], 0, GD_KT, t_gpflt, 0);
+	SETGATE(idt[T_PGFLT], 0, GD_KT, t_pgflt, 0);
+	SETGATE(idt[T_FPERR], 0, GD_KT, t_fperr, 0);
+	SETGATE(idt[T_ALIGN], 0, GD_KT, t_align, 0);
+	SETGATE(idt[T_MCHK], 0, GD_KT, t_mchk, 0);
+	SETGATE(idt[T_SIMDERR], 0, GD_KT, t_simderr, 0);
+
+	// Hardware interrupts arrive with interrupts disabled, and
+	// stay so until the handler returns.
+	for (i = 0; i < 16; i++)
+		SETGATE(idt[IRQ_OFFSET + i], 0, GD_KT, irqs[i], 0);
+	SETGATE(idt[T_LAPIC_SPURIOUS], 0, GD_KT, t_lapic_spurious, 0);
+
+	// Per-CPU setup 
+	trap_init_percpu();
+}
+
+// Initialize and load the per-CPU GDT and TSS, and point %gs at this
+// CPU's CpuInfo.  Every CPU has its own GDT, so that each can have its
+// own TSS descriptor (a TSS is marked busy in the GDT while it is
+// loaded) and its own GD_CPU segment.  Until this runs, thiscpu and
+// cpunum() do not work on this CPU.
+void
+trap_init_percpu(void)
+{
+	struct CpuInfo *c = &cpus[cpu_identify()];
+	struct Pseudodesc gdt_pd = {
+		sizeof(c->cpu_gdt) - 1, (uint32_t) c->cpu_gdt
+	};
+
+	c->cpu_gdt[0] = SEG_NULL;
+	c->cpu_gdt[GD_KT >> 3] = SEG(STA_X | STA_R, 0x0, 0xffffffff, 0);
+	c->cpu_gdt[GD_KD >> 3] = SEG(STA_W, 0x0, 0xffffffff, 0);
+	c->cpu_gdt[GD_UT >> 3] = SEG(STA_X | STA_R, 0x0, 0xffffffff, 3);
+	c->cpu_gdt[GD_UD >> 3] = SEG(STA_W, 0x0, 0xffffffff, 3);
+
+	// Setup a TSS so that we get the right stack
+	// when we trap to the kernel.
+	c->cpu_ts.ts_esp0 = KSTACKTOP - c->cpu_id * (KSTKSIZE + KSTKGAP);
+	c->cpu_ts.ts_ss0 = GD_KD;
+	c->cpu_ts.ts_iomb = sizeof(struct Taskstate);
+
+	c->cpu_gdt[GD_TSS >> 3] = SEG16(STS_T32A, (uint32_t) (&c->cpu_ts),
+					sizeof(struct Taskstate) - 1, 0);
+	c->cpu_gdt[GD_TSS >> 3].sd_s = 0;
+
+	// A byte-granular data segment covering just this CpuInfo
+	c->cpu_self = c;
+	c->cpu_gdt[GD_CPU >> 3] = SEG16(STA_W, (uint32_t) c,
+					sizeof(struct CpuInfo) - 1, 0);
+
+	// Load the GDT and reload the segment registers from it.
+	lgdt(&gdt_pd);
+	asm volatile("movw %%ax,%%gs" :: "a" (GD_CPU));
+	asm volatile("movw %%ax,%%fs" :: "a" (GD_UD|3));
+	asm volatile("movw %%ax,%%es" :: "a" (GD_KD));
+	asm volatile("movw %%ax,%%ds" :: "a" (GD_KD));
+	asm volatile("movw %%ax,%%ss" :: "a" (GD_KD));
+	asm volatile("ljmp %0,$1f\n 1:\n" :: "i" (GD_KT));  // reload cs
+	lldt(0);
+
+	// Load the TSS selector (like other segment selectors, the
+	// bottom three bits are special; we leave them 0)
+	ltr(GD_TSS);
+
+	// Load the IDT
+	lidt(&idt_pd);
+}
+
+void
+print_trapframe(struct Trapframe *tf)
+{
+	cprintf("TRAP frame at %p from CPU %d\n", tf, cpunum());
+	print_regs(&tf->tf_regs);
+	cprintf("  es   0x----%04x\n", tf->tf_es);
+	cprintf("  ds   0x----%04x\n", tf->tf_ds);
+	cprintf("  trap 0x%08x %s\n", tf->tf_trapno, trapname(tf->tf_trapno));
+	if (tf->tf_trapno == T_PGFLT)
+		cprintf("  cr2  0x%08x\n", rcr2());
+	cprintf("  err  0x%08x\n", tf->tf_err);
+	cprintf("  eip  0x%08x\n", tf->tf_eip);
+	cprintf("  cs   0x----%04x\n", tf->tf_cs);
+	cprintf("  flag 0x%08x\n", tf->tf_eflags);
+}
+
+void
+print_regs(struct PushRegs *regs)
+{
+	cprintf("  edi  0x%08x\n", regs->reg_edi);
+	cprintf("  esi  0x%08x\n", regs->reg_esi);
+	cprintf("  ebp  0x%08x\n", regs->reg_ebp);
+	cprintf("  oesp 0x%08x\n", regs->reg_oesp);
+	cprintf("  ebx  0x%08x\n", regs->reg_ebx);
+	cprintf("  edx  0x%08x\n", regs->reg_edx);
+	cprintf("  ecx  0x%08x\n", regs->reg_ecx);
+	cprintf("  eax  0x%08x\n", regs->reg_eax);
+}
+
+// Handle a trap.  Every trap comes from the kernel, since there are
+// no user environments; device interrupts return to the interrupted
+// code, and anything else is a kernel bug.
+void
+trap(struct Trapframe *tf)
+{
+	switch (tf->tf_trapno) {
+	case IRQ_OFFSET + IRQ_SPURIOUS:
+		// Handle spurious interrupts
+		// The hardware sometimes raises these because of noise on the
+		// IRQ line or other reasons. We don't care.
+		cprintf("Spurious interrupt on irq 7\n");
+		return;
+
+	case T_LAPIC_SPURIOUS:
+		// The local APIC raised no real interrupt, so it expects
+		// no EOI.
+		return;
+
+	case IRQ_OFFSET + IRQ_KBD:
+		kbd_intr();
+		return;
+
+	case IRQ_OFFSET + IRQ_SERIAL:
+		serial_intr();
+		return;
+	}
+
+	print_trapframe(tf);
+	panic("unhandled trap in kernel");
+}
@@ -0,0 +1,66 @@
+/* See COPYRIGHT for copyright information. */
+
+// Time stamp counter calibration against the 8254 PIT.
+
+#include <inc/x86.h>
+
+#include <kern/tsc.h>
+
+#define PIT_HZ		1193182
+#define PIT_CH2		0x42	// channel 2 counter
+#define PIT_MODE	0x43
+#define   PIT_SEL_CH2	0x80
+#define   PIT_RW_16BIT	0x30	// low byte, then high byte
+#define   PIT_MODE0	0x00	// interrupt on terminal count
+#define PORTB		0x61	// NMI status and control
+#define   PORTB_GATE2	0x01	// PIT channel 2 gate
+#define   PORTB_SPKR	0x02	// speaker data enable
+#define   PORTB_OUT2	0x20	// PIT channel 2 output
+
+#define CAL_MS		10	// calibration interval
+
+static uint32_t khz;
+
+// Count TSC cycles while PIT channel 2 counts down CAL_MS milliseconds.
+static uint32_t
+tsc_calibrate(void)
+{
+	uint32_t latch = PIT_HZ / (1000 / CAL_MS);
+	uint64_t t0, t1;
+	uint8_t portb;
+
+	// gate channel 2 on, keep the speaker off
+	portb = inb(PORTB);
+	outb(PORTB, (portb & ~PORTB_SPKR) | PORTB_GATE2);
+
+	// mode 0: OUT2 goes high when the count reaches zero
+	outb(PIT_MODE, PIT_SEL_CH2 | PIT_RW_16BIT | PIT_MODE0);
+	outb(PIT_CH2, latch & 0xFF);
+	outb(PIT_CH2, latch >> 8);
+
+	t0 = read_tsc();
+	while (!(inb(PORTB) & PORTB_OUT2))
+		/* do nothing */;
+	t1 = read_tsc();
+
+	outb(PORTB, portb);
+	return (t1 - t0) / CAL_MS;
+}
+
+// Return the TSC frequency in kHz, calibrating it on first use.
+uint32_t
+tsc_khz(void)
+{
+	if (khz == 0)
+		khz = tsc_calibrate();
+	return khz;
+}
+
+// Convert a TSC cycle count to microseconds.
+uint64_t
+tsc_to_us(uint64_t cycles)
+{
+	uint32_t k = tsc_khz();
+
+	return k ? cycles * 1000 / k : 0;
+}
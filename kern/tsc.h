@@ -0,0 +1,26 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_TSC_H
+#define JOS_KERN_TSC_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+#include <inc/x86.h>
+#include <inc/bootinfo.h>
+
+// Boot milestone timestamps, indexed by BOOT_TS_* (kern/entry.S).
+// An entry of 0 means the milestone was not recorded.
+extern uint64_t boot_tsc[BOOT_NSTAMP];
+
+static __inline void
+boot_stamp(int i)
+{
+	boot_tsc[i] = read_tsc();
+}
+
+uint32_t tsc_khz(void);
+uint64_t tsc_to_us(uint64_t cycles);
+
+#endif	// !JOS_KERN_TSC_H
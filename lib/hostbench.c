@@ -0,0 +1,435 @@
+/*
+ * hostbench: test and time lib/string.c and lib/printfmt.c on the host.
+ *
+ *	hostbench [-t | -b] [-s seed]
+ *
+ * The JOS routines are compiled natively with their names prefixed
+ * by jos_ (see lib/Makefrag), so that they link alongside the C
+ * library's.  hostbench first checks them against the C library on
+ * randomly generated inputs (-t does only this), then times both
+ * (-b does only this).  It exits with status 1 if any check fails.
+ * This is a host program, built with $(NCC) -m32.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// lib/ is built for 32-bit x86, where size_t is an unsigned int.
+typedef unsigned int jsize_t;
+
+void *	jos_memset(void *dst, int c, jsize_t len);
+void *	jos_memmove(void *dst, const void *src, jsize_t len);
+void *	jos_memcpy(void *dst, const void *src, jsize_t len);
+int	jos_memcmp(const void *s1, const void *s2, jsize_t len);
+void *	jos_memfind(const void *s, int c, jsize_t len);
+int	jos_strlen(const char *s);
+int	jos_strnlen(const char *s, jsize_t size);
+char *	jos_strchr(const char *s, char c);
+int	jos_strcmp(const char *s1, const char *s2);
+int	jos_strncmp(const char *s1, const char *s2, jsize_t size);
+jsize_t	jos_strlcpy(char *dst, const char *src, jsize_t size);
+long	jos_strtol(const char *s, char **endptr, int base);
+int	jos_snprintf(char *buf, int n, const char *fmt, ...);
+
+#define MIN(a, b)	((a) < (b) ? (a) : (b))
+
+#define BUFSZ	8192
+#define ROUNDS	100000		// random cases per check
+
+static unsigned char a[BUFSZ], b[BUFSZ], ra[BUFSZ], rb[BUFSZ];
+static int nfail;
+
+static void
+fail(const char *what, int round, const char *detail)
+{
+	if (nfail++ < 20)
+		printf("FAIL %s (round %d)%s%s\n", what, round,
+		       detail ? ": " : "", detail ? detail : "");
+}
+
+static int
+sign(int x)
+{
+	return (x > 0) - (x < 0);
+}
+
+// Fill a buffer with random bytes, none of them zero if nonzero is set.
+// rand() is too slow for whole buffers every round.
+static void
+fill(unsigned char *p, int n, int nonzero)
+{
+	static uint32_t x = 2463534242U;
+
+	while (n-- > 0) {
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		*p = x;
+		if (nonzero && *p == 0)
+			*p = 1;
+		p++;
+	}
+}
+
+/***** Correctness checks *****/
+
+// Random offsets and lengths, biased toward the small sizes and
+// misalignments where the word-at-a-time code has its edge cases.
+static int
+randlen(int max)
+{
+	return rand() % 4 ? rand() % 70 % max : rand() % max;
+}
+
+static void
+check_mem(void)
+{
+	int i, n, so, dof, c;
+	void *r;
+
+	for (i = 0; i < ROUNDS; i++) {
+		n = randlen(BUFSZ / 2);
+		so = rand() % (BUFSZ / 2);
+		dof = rand() % (BUFSZ / 2);
+		c = rand() & 0xFF;
+		fill(a, BUFSZ, 0);
+		memcpy(ra, a, BUFSZ);
+
+		// memmove within one buffer, so that the copies overlap
+		memmove(ra + dof, ra + so, n);
+		if (jos_memmove(a + dof, a + so, n) != a + dof
+		    || memcmp(a, ra, BUFSZ) != 0)
+			fail("memmove", i, NULL);
+
+		fill(b, BUFSZ, 0);
+		memcpy(ra + dof, b + so, n);
+		if (jos_memcpy(a + dof, b + so, n) != a + dof
+		    || memcmp(a, ra, BUFSZ) != 0)
+			fail("memcpy", i, NULL);
+
+		memset(ra + so, c, n);
+		if (jos_memset(a + so, c, n) != a + so
+		    || memcmp(a, ra, BUFSZ) != 0)
+			fail("memset", i, NULL);
+
+		// equal but for at most one byte
+		memcpy(b + dof, a + so, n);
+		if (n > 0 && rand() % 2)
+			b[dof + rand() % n] = rand();
+		if (sign(jos_memcmp(a + so, b + dof, n))
+		    != sign(memcmp(a + so, b + dof, n)))
+			fail("memcmp", i, NULL);
+
+		r = memchr(a + so, c, n);
+		if (jos_memfind(a + so, c, n) != (r ? r : a + so + n))
+			fail("memfind", i, NULL);
+	}
+}
+
+static void
+check_str(void)
+{
+	int i, n, so, m, c;
+	char *s, *t;
+
+	for (i = 0; i < ROUNDS; i++) {
+		n = randlen(BUFSZ / 2);
+		so = rand() % (BUFSZ / 2);
+		// a small alphabet, so that strchr and strcmp find things
+		for (m = so; m < so + n; m++)
+			a[m] = 'a' + rand() % 8;
+		a[so + n] = '\0';
+		s = (char *) a + so;
+		c = rand() % 3 ? 'a' + rand() % 9 : 0;
+
+		if (jos_strlen(s) != (int) strlen(s))
+			fail("strlen", i, NULL);
+		m = rand() % (n + 2);
+		if (jos_strnlen(s, m) != (int) strnlen(s, m))
+			fail("strnlen", i, NULL);
+		// JOS strchr returns null when looking for the null
+		if (jos_strchr(s, c) != (c ? strchr(s, c) : NULL))
+			fail("strchr", i, NULL);
+
+		t = (char *) b + rand() % 16;
+		strcpy(t, s);
+		if (n > 0 && rand() % 2)
+			t[rand() % n] = 'a' + rand() % 8;
+		if (sign(jos_strcmp(s, t)) != sign(strcmp(s, t)))
+			fail("strcmp", i, NULL);
+		if (sign(jos_strncmp(s, t, m)) != sign(strncmp(s, t, m)))
+			fail("strncmp", i, NULL);
+
+		// JOS strlcpy returns the length copied, not strlen(src)
+		memset(rb, 0x55, 128);
+		memset(rb + 128, 0x55, 128);
+		m = rand() % 64;
+		c = m ? MIN(n, m - 1) : 0;
+		if (jos_strlcpy((char *) rb, s, m) != c
+		    || (m && (memcmp(rb, s, c) != 0 || rb[c] != '\0'))
+		    || memcmp(rb + c + (m > 0), rb + 128, 128 - c - (m > 0)) != 0)
+			fail("strlcpy", i, NULL);
+	}
+}
+
+static void
+check_strtol(void)
+{
+	static const int bases[] = { 0, 8, 10, 16 };
+	static const char digits[] = "0123456789abcdefABCDEF";
+	char buf[32], *ep, *rep;
+	int i, j, n, base;
+	long v, rv;
+
+	for (i = 0; i < ROUNDS; i++) {
+		base = bases[rand() % 4];
+		j = 0;
+		if (rand() % 4 == 0)
+			buf[j++] = ' ';
+		if (rand() % 4 == 0)
+			buf[j++] = "+-"[rand() % 2];
+		// stay within 31 bits, since JOS does not detect overflow
+		n = rand() % 8;
+		// "0x" followed by no digits is parsed differently
+		if ((base == 0 || base == 16) && n > 0 && rand() % 4 == 0) {
+			buf[j++] = '0';
+			buf[j++] = 'x';
+		}
+		for (; n > 0; n--)
+			buf[j++] = digits[rand() % 22];
+		buf[j] = '\0';
+
+		v = jos_strtol(buf, &ep, base);
+		rv = strtol(buf, &rep, base);
+		// With no digits, JOS points endptr past any sign and
+		// spaces, where the C library points it at the start.
+		if (v != rv || (rep != buf && ep != rep)) {
+			char detail[64];
+			snprintf(detail, sizeof detail,
+				 "\"%s\" base %d: %ld, want %ld", buf, base, v, rv);
+			fail("strtol", i, detail);
+		}
+	}
+}
+
+// Append a random conversion to fmt, and format it with both the JOS
+// and the C library snprintf.  Sticks to what the two agree on: JOS
+// puts a minus sign before any padding and has no left-justified
+// numbers, so signed numbers get no width, and %c none at all.
+static void
+check_printf(void)
+{
+	static const char *strs[] = { "", "x", "hello", "a longer string" };
+	static const char *unprint[] = { "\a", "tab\there", "\x7f\x80" "end" };
+	char fmt[32], want[128], got[128], detail[300], buf[32];
+	int i, j, w, r, jr;
+	unsigned long long v;
+	const char *s;
+
+	for (i = 0; i < ROUNDS; i++) {
+		w = rand() % 4 ? rand() % 20 : 0;
+		s = strs[rand() % 4];
+		v = (unsigned long long) rand() << 33 ^ (unsigned) rand() << 2
+			^ rand() % 4;
+		v >>= rand() % 64;
+		switch (rand() % 10) {
+		case 0:
+			snprintf(fmt, sizeof fmt, "<%%d>");
+			r = snprintf(want, sizeof want, fmt, (int) v);
+			jr = jos_snprintf(got, sizeof got, fmt, (int) v);
+			break;
+		case 1:
+			snprintf(fmt, sizeof fmt, "<%%%s%dd>", rand() % 2 ? "0" : "", w);
+			r = snprintf(want, sizeof want, fmt, (int) v & 0x7FFFFFFF);
+			jr = jos_snprintf(got, sizeof got, fmt, (int) v & 0x7FFFFFFF);
+			break;
+		case 2:
+			snprintf(fmt, sizeof fmt, "<%%%s%du>", rand() % 2 ? "0" : "", w);
+			r = snprintf(want, sizeof want, fmt, (unsigned) v);
+			jr = jos_snprintf(got, sizeof got, fmt, (unsigned) v);
+			break;
+		case 3:
+			snprintf(fmt, sizeof fmt, "<%%%s%dx>", rand() % 2 ? "0" : "", w);
+			r = snprintf(want, sizeof want, fmt, (unsigned) v);
+			jr = jos_snprintf(got, sizeof got, fmt, (unsigned) v);
+			break;
+		case 4:
+			snprintf(fmt, sizeof fmt, "<%%%s%do>", rand() % 2 ? "0" : "", w);
+			r = snprintf(want, sizeof want, fmt, (unsigned) v);
+			jr = jos_snprintf(got, sizeof got, fmt, (unsigned) v);
+			break;
+		case 5:
+			snprintf(fmt, sizeof fmt, "<%%%s%dll%c>",
+				 rand() % 2 ? "0" : "", w, "uxo"[rand() % 3]);
+			r = snprintf(want, sizeof want, fmt, v);
+			jr = jos_snprintf(got, sizeof got, fmt, v);
+			break;
+		case 6:
+			snprintf(fmt, sizeof fmt, "<%%lld>");
+			r = snprintf(want, sizeof want, fmt, (long long) v);
+			jr = jos_snprintf(got, sizeof got, fmt, (long long) v);
+			break;
+		case 7:
+			// a width of 0 would read as the 0 flag
+			w++;
+			if (rand() % 2)
+				snprintf(fmt, sizeof fmt, "<%%%s%ds>",
+					 rand() % 2 ? "-" : "", w);
+			else
+				// JOS reads a precision of 0 as the 0 flag
+				snprintf(fmt, sizeof fmt, "<%%%s%d.%ds>",
+					 rand() % 2 ? "-" : "", w, 1 + rand() % 8);
+			r = snprintf(want, sizeof want, fmt, s);
+			jr = jos_snprintf(got, sizeof got, fmt, s);
+			break;
+		case 8:
+			// %#s prints unprintable characters as '?', and must
+			// still pad to the full width when left-justified
+			s = rand() % 2 ? strs[rand() % 4] : unprint[rand() % 3];
+			for (j = 0; s[j]; j++)
+				buf[j] = s[j] >= ' ' && s[j] <= '~' ? s[j] : '?';
+			buf[j] = '\0';
+			w++;
+			snprintf(fmt, sizeof fmt, "<%%-%ds>", w);
+			r = snprintf(want, sizeof want, fmt, buf);
+			snprintf(fmt, sizeof fmt, "<%%-#%ds>", w);
+			jr = jos_snprintf(got, sizeof got, fmt, s);
+			break;
+		default:
+			snprintf(fmt, sizeof fmt, "<%%c%%%%>");
+			r = snprintf(want, sizeof want, fmt, ' ' + (int) (v % 95));
+			jr = jos_snprintf(got, sizeof got, fmt, ' ' + (int) (v % 95));
+			break;
+		}
+		if (r != jr || strcmp(want, got) != 0) {
+			snprintf(detail, sizeof detail, "\"%s\": \"%s\", want \"%s\"",
+				 fmt, got, want);
+			fail("snprintf", i, detail);
+		}
+	}
+}
+
+/***** Benchmarks *****/
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Time op, run in batches until at least 0.1s has passed, and
+// return nanoseconds per call.
+#define TIME(ns, op)							\
+	do {								\
+		double __t0 = now(), __t;				\
+		long __n = 0, __i, __batch = 64;			\
+		do {							\
+			for (__i = 0; __i < __batch; __i++)		\
+				op;					\
+			__n += __batch;					\
+			__batch *= 2;					\
+		} while ((__t = now() - __t0) < 0.1);			\
+		ns = __t * 1e9 / __n;					\
+	} while (0)
+
+static volatile long sink;
+
+static void
+bench_line(const char *name, int bytes, double jns, double lns)
+{
+	printf("%-16s %6d %10.1f %10.1f", name, bytes, jns, lns);
+	if (bytes > 0)
+		printf(" %9.0f %9.0f", bytes / jns * 1e3, bytes / lns * 1e3);
+	printf("\n");
+}
+
+static void
+bench(void)
+{
+	static const int sizes[] = { 16, 64, 256, 1024, 4096 };
+	double jns, lns;
+	int i, n;
+
+	printf("%-16s %6s %10s %10s %9s %9s\n", "", "bytes", "jos ns",
+	       "libc ns", "jos MB/s", "libc MB/s");
+	// printable, so that strchr's needle below never turns up
+	for (i = 0; i < BUFSZ; i++)
+		a[i] = 'a' + i % 26;
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		n = sizes[i];
+		TIME(jns, jos_memcpy(b, a, n));
+		TIME(lns, memcpy(b, a, n));
+		bench_line("memcpy", n, jns, lns);
+		TIME(jns, jos_memcpy(b + 1, a + 3, n));
+		TIME(lns, memcpy(b + 1, a + 3, n));
+		bench_line("memcpy-unaligned", n, jns, lns);
+		TIME(jns, jos_memmove(b + 8, b, n));
+		TIME(lns, memmove(b + 8, b, n));
+		bench_line("memmove-back", n, jns, lns);
+		TIME(jns, jos_memset(b, 0, n));
+		TIME(lns, memset(b, 0, n));
+		bench_line("memset", n, jns, lns);
+		memcpy(b, a, n);
+		TIME(jns, sink = jos_memcmp(a, b, n));
+		TIME(lns, sink = memcmp(a, b, n));
+		bench_line("memcmp", n, jns, lns);
+		memcpy(b, a, n);
+		b[n - 1] = '\0';
+		TIME(jns, sink = jos_strlen((char *) b));
+		TIME(lns, sink = strlen((char *) b));
+		bench_line("strlen", n, jns, lns);
+		// a needle that is not there, so the whole string is scanned
+		TIME(jns, sink = (long) jos_strchr((char *) b, 0x80));
+		TIME(lns, sink = (long) strchr((char *) b, 0x80));
+		bench_line("strchr", n, jns, lns);
+	}
+
+	TIME(jns, jos_snprintf((char *) b, 128, "%d %s %08x %llu", i, "bench",
+			       i, (unsigned long long) n));
+	TIME(lns, snprintf((char *) b, 128, "%d %s %08x %llu", i, "bench",
+			   i, (unsigned long long) n));
+	bench_line("snprintf", 0, jns, lns);
+}
+
+int
+main(int argc, char **argv)
+{
+	int opt, test = 1, timing = 1;
+	unsigned seed = time(NULL);
+
+	while ((opt = getopt(argc, argv, "tbs:")) != -1)
+		switch (opt) {
+		case 't':
+			timing = 0;
+			break;
+		case 'b':
+			test = 0;
+			break;
+		case 's':
+			seed = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr, "usage: hostbench [-t | -b] [-s seed]\n");
+			exit(2);
+		}
+
+	if (test) {
+		printf("checking against the C library, seed %u\n", seed);
+		srand(seed);
+		check_mem();
+		check_str();
+		check_strtol();
+		check_printf();
+		printf("%s: %d failures\n", nfail ? "FAILED" : "ok", nfail);
+	}
+	if (timing)
+		bench();
+	return nfail ? 1 : 0;
+}
@@ -29,25 +29,111 @@ static const char * const error_string[MAXERROR + 1] =
 	"segmentation fault",
 };
 
+// Emit n copies of padc.
+static void
+printpad(void (*putspan)(const char*, int, void*), void *putdat,
+	 int padc, int n)
+{
+	char pad[16];
+	int m;
+
+	if (n <= 0)
+		return;
+	memset(pad, padc, MIN(n, (int) sizeof(pad)));
+	for (; n > 0; n -= m) {
+		m = MIN(n, (int) sizeof(pad));
+		putspan(pad, m, putdat);
+	}
+}
+
+static const char digits[] = "0123456789abcdef";
+
+// Two decimal digits at a time
+static const char digits100[] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+// Write the decimal digits of n so that they end just before p,
+// with at least 'min' digits (zero-filled).  Returns the first digit.
+static char *
+fmtdec32(char *p, uint32_t n, int min)
+{
+	char *e = p;
+	uint32_t r;
+
+	while (n >= 100) {
+		r = n % 100;
+		n /= 100;
+		p -= 2;
+		p[0] = digits100[2 * r];
+		p[1] = digits100[2 * r + 1];
+	}
+	if (n >= 10) {
+		p -= 2;
+		p[0] = digits100[2 * n];
+		p[1] = digits100[2 * n + 1];
+	} else
+		*--p = '0' + n;
+	while (e - p < min)
+		*--p = '0';
+	return p;
+}
+
 /*
- * Print a number (base <= 16) in reverse order,
- * using specified putch function and associated pointer putdat.
+ * Print a number (base <= 16), right-justified in 'width' columns
+ * padded with padc, using specified putspan function and associated
+ * pointer putdat.  Digits are generated right to left into a buffer:
+ * by shifts and masks for bases 8 and 16, two at a time for base 10,
+ * and with 32-bit arithmetic whenever the value fits, so that 64-bit
+ * division (a libgcc call on i386) is only used on 64-bit values.
  */
 static void
-printnum(void (*putch)(int, void*), void *putdat,
+printnum(void (*putspan)(const char*, int, void*), void *putdat,
 	 unsigned long long num, unsigned base, int width, int padc)
 {
-	// first recursively print all preceding (more significant) digits
-	if (num >= base) {
-		printnum(putch, putdat, num / base, base, width - 1, padc);
+	char buf[24];			// 2^64 in octal is 22 digits
+	char *p = buf + sizeof(buf);
+	uint32_t n32;
+	int shift;
+
+	if (base == 8 || base == 16) {
+		shift = (base == 8 ? 3 : 4);
+		for (; num >> 32; num >>= shift)
+			*--p = digits[num & (base - 1)];
+		n32 = num;
+		do {
+			*--p = digits[n32 & (base - 1)];
+			n32 >>= shift;
+		} while (n32);
+	} else if (base == 10) {
+		// Split off nine digits at a time until the rest fits
+		// in 32 bits.
+		while (num >> 32) {
+			p = fmtdec32(p, num % 1000000000, 9);
+			num /= 1000000000;
+		}
+		p = fmtdec32(p, num, 1);
 	} else {
-		// print any needed pad characters before first digit
-		while (--width > 0)
-			putch(padc, putdat);
+		for (; num >> 32; num /= base)
+			*--p = digits[num % base];
+		n32 = num;
+		do {
+			*--p = digits[n32 % base];
+			n32 /= base;
+		} while (n32);
 	}
 
-	// then print this (the least significant) digit
-	putch("0123456789abcdef"[num % base], putdat);
+	// print any needed pad characters before first digit
+	printpad(putspan, putdat, padc, width - (buf + sizeof(buf) - p));
+	putspan(p, buf + sizeof(buf) - p, putdat);
 }
 
 // Get an unsigned int of various possible sizes from a varargs list,
@@ -77,24 +163,30 @@ getint(va_list *ap, int lflag)
 }
 
 
-// Main function to format and print a string.
-void printfmt(void (*putch)(int, void*), void *putdat, const char *fmt, ...);
+static void spanfmt(void (*putspan)(const char*, int, void*), void *putdat,
+		    const char *fmt, ...);
 
+// Main function to format and print a string.
+// Output goes to putspan in contiguous runs: each literal stretch of
+// the format, each string argument and each formatted number arrives
+// as one or a few calls, rather than one call per character.
 void
-vprintfmt(void (*putch)(int, void*), void *putdat, const char *fmt, va_list ap)
+vspanfmt(void (*putspan)(const char*, int, void*), void *putdat,
+	 const char *fmt, va_list ap)
 {
 	register const char *p;
 	register int ch, err;
 	unsigned long long num;
-	int base, lflag, width, precision, altflag;
-	char padc;
+	int base, lflag, width, precision, altflag, len, n;
+	char padc, c;
 
 	while (1) {
-		while ((ch = *(unsigned char *) fmt++) != '%') {
-			if (ch == '\0')
-				return;
-			putch(ch, putdat);
-		}
+		for (p = fmt; *fmt != '%' && *fmt != '\0'; fmt++)
+			/* do nothing */;
+		if (fmt > p)
+			putspan(p, fmt - p, putdat);
+		if (*fmt++ == '\0')
+			return;
 
 		// Process a %-escape sequence
 		padc = ' ';
@@ -158,7 +250,8 @@ vprintfmt(void (*putch)(int, void*), void *putdat, const char *fmt, va_list ap)
 
 		// character
 		case 'c':
-			putch(va_arg(ap, int), putdat);
+			c = va_arg(ap, int);
+			putspan(&c, 1, putdat);
 			break;
 
 		// error message
@@ -167,32 +260,44 @@ vprintfmt(void (*putch)(int, void*), void *putdat, const char *fmt, va_list ap)
 			if (err < 0)
 				err = -err;
 			if (err > MAXERROR || (p = error_string[err]) == NULL)
-				printfmt(putch, putdat, "error %d", err);
+				spanfmt(putspan, putdat, "error %d", err);
 			else
-				printfmt(putch, putdat, "%s", p);
+				putspan(p, strlen(p), putdat);
 			break;
 
 		// string
 		case 's':
 			if ((p = va_arg(ap, char *)) == NULL)
 				p = "(null)";
-			if (width > 0 && padc != '-')
-				for (width -= strnlen(p, precision); width > 0; width--)
-					putch(padc, putdat);
-			for (; (ch = *p++) != '\0' && (precision < 0 || --precision >= 0); width--)
-				if (altflag && (ch < ' ' || ch > '~'))
-					putch('?', putdat);
-				else
-					putch(ch, putdat);
-			for (; width > 0; width--)
-				putch(' ', putdat);
+			len = strnlen(p, precision);
+			if (padc != '-') {
+				printpad(putspan, putdat, padc, width - len);
+				width = 0;
+			}
+			if (!altflag)
+				putspan(p, len, putdat);
+			else
+				// Replace unprintable characters with '?'.
+				// len stays put for the padding below.
+				for (n = len; n > 0; p += ch, n -= ch) {
+					for (ch = 0; ch < n
+						     && p[ch] >= ' ' && p[ch] <= '~'; ch++)
+						/* do nothing */;
+					if (ch > 0)
+						putspan(p, ch, putdat);
+					if (ch < n) {
+						putspan("?", 1, putdat);
+						ch++;
+					}
+				}
+			printpad(putspan, putdat, ' ', width - len);
 			break;
 
 		// (signed) decimal
 		case 'd':
 			num = getint(&ap, lflag);
 			if ((long long) num < 0) {
-				putch('-', putdat);
+				putspan("-", 1, putdat);
 				num = -(long long) num;
 			}
 			base = 10;
@@ -213,8 +318,7 @@ vprintfmt(void (*putch)(int, void*), void *putdat, const char *fmt, va_list ap)
 			
 		// pointer
 		case 'p':
-			putch('0', putdat);
-			putch('x', putdat);
+			putspan("0x", 2, putdat);
 			num = (unsigned long long)
 				(uintptr_t) va_arg(ap, void *);
 			base = 16;
@@ -225,17 +329,17 @@ vprintfmt(void (*putch)(int, void*), void *putdat, const char *fmt, va_list ap)
 			num = getuint(&ap, lflag);
 			base = 16;
 		number:
-			printnum(putch, putdat, num, base, width, padc);
+			printnum(putspan, putdat, num, base, width, padc);
 			break;
 
 		// escaped '%' character
 		case '%':
-			putch(ch, putdat);
+			putspan("%", 1, putdat);
 			break;
 			
 		// unrecognized escape sequence - just print it literally
 		default:
-			putch('%', putdat);
+			putspan("%", 1, putdat);
 			for (fmt--; fmt[-1] != '%'; fmt--)
 				/* do nothing */;
 			break;
@@ -243,6 +347,38 @@ vprintfmt(void (*putch)(int, void*), void *putdat, const char *fmt, va_list ap)
 	}
 }
 
+static void
+spanfmt(void (*putspan)(const char*, int, void*), void *putdat,
+	const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	vspanfmt(putspan, putdat, fmt, ap);
+	va_end(ap);
+}
+
+// vprintfmt's per-character callback, seen as a span sink
+struct putchsink {
+	void (*putch)(int, void*);
+	void *putdat;
+};
+
+static void
+putchspan(const char *s, int n, struct putchsink *sink)
+{
+	for (; n > 0; n--)
+		sink->putch(*(const unsigned char *) s++, sink->putdat);
+}
+
+void
+vprintfmt(void (*putch)(int, void*), void *putdat, const char *fmt, va_list ap)
+{
+	struct putchsink sink = { putch, putdat };
+
+	vspanfmt((void*)putchspan, &sink, fmt, ap);
+}
+
 void
 printfmt(void (*putch)(int, void*), void *putdat, const char *fmt, ...)
 {
@@ -260,11 +396,15 @@ struct sprintbuf {
 };
 
 static void
-sprintputch(int ch, struct sprintbuf *b)
+sprintputspan(const char *s, int n, struct sprintbuf *b)
 {
-	b->cnt++;
-	if (b->buf < b->ebuf)
-		*b->buf++ = ch;
+	int m = MIN(n, b->ebuf - b->buf);
+
+	b->cnt += n;
+	if (m > 0) {
+		memcpy(b->buf, s, m);
+		b->buf += m;
+	}
 }
 
 int
@@ -276,7 +416,7 @@ vsnprintf(char *buf, int n, const char *fmt, va_list ap)
 		return -E_INVAL;
 
 	// print the string to the buffer
-	vprintfmt((void*)sprintputch, &b, fmt, ap);
+	vspanfmt((void*)sprintputspan, &b, fmt, ap);
 
 	// null terminate the buffer
 	*b.buf = '\0';
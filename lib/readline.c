@@ -4,6 +4,26 @@
 #define BUFLEN 1024
 static char buf[BUFLEN];
 
+// Input taken from the console but not yet consumed, such as
+// whatever was typed ahead after the last line's newline
+static char inbuf[64];
+static int inpos, inlen;
+
+static int
+readc(void)
+{
+	int r;
+
+	// Take everything pending in one go.
+	if (inpos == inlen) {
+		if ((r = getchars(inbuf, sizeof(inbuf))) < 0)
+			return r;
+		inpos = 0;
+		inlen = r;
+	}
+	return (unsigned char) inbuf[inpos++];
+}
+
 char *
 readline(const char *prompt)
 {
@@ -15,7 +35,7 @@ readline(const char *prompt)
 	i = 0;
 	echoing = iscons(0);
 	while (1) {
-		c = getchar();
+		c = readc();
 		if (c < 0) {
 			cprintf("read error: %e\n", c);
 			return NULL;
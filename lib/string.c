@@ -8,14 +8,31 @@
 // Primespipe runs 3x faster this way.
 #define ASM 1
 
+// The scanning routines below look at a word at a time.  An aligned
+// word never straddles a page, so reading all of the word that holds
+// the terminating null is safe even when the bytes after it are not.
+typedef uint32_t __attribute__((__may_alias__)) word_t;
+
+#define ONES		0x01010101
+#define HIGHS		0x80808080
+// Nonzero iff some byte of w is zero
+#define HASZERO(w)	(((w) - ONES) & ~(w) & HIGHS)
+#define ALIGNED(p)	(((uintptr_t) (p) & (sizeof(word_t) - 1)) == 0)
+
 int
 strlen(const char *s)
 {
-	int n;
+	const char *p;
+	const word_t *w;
 
-	for (n = 0; *s != '\0'; s++)
-		n++;
-	return n;
+	for (p = s; !ALIGNED(p); p++)
+		if (*p == '\0')
+			return p - s;
+	for (w = (const word_t *) p; !HASZERO(*w); w++)
+		/* do nothing */;
+	for (p = (const char *) w; *p != '\0'; p++)
+		/* do nothing */;
+	return p - s;
 }
 
 int
@@ -92,10 +109,19 @@ strncmp(const char *p, const char *q, size_t n)
 char *
 strchr(const char *s, char c)
 {
-	for (; *s; s++)
-		if (*s == c)
-			return (char *) s;
-	return 0;
+	const word_t *w;
+	uint32_t cs = (unsigned char) c * ONES;
+
+	for (; !ALIGNED(s); s++)
+		if (*s == '\0' || *s == c)
+			goto found;
+	// skip words with neither a null nor a 'c'
+	for (w = (const word_t *) s; !HASZERO(*w) && !HASZERO(*w ^ cs); w++)
+		/* do nothing */;
+	for (s = (const char *) w; *s != '\0' && *s != c; s++)
+		/* do nothing */;
+found:
+	return *s ? (char *) s : 0;
 }
 
 // Return a pointer to the first occurrence of 'c' in 's',
@@ -110,53 +136,104 @@ strfind(const char *s, char c)
 }
 
 #if ASM
+// Below this size, setting up aligned word moves costs more than it saves.
+#define SMALL	16
+
 void *
 memset(void *v, int c, size_t n)
 {
 	char *p;
+	size_t m;
 
-	if (n == 0)
-		return v;
-	if ((int)v%4 == 0 && n%4 == 0) {
-		c &= 0xFF;
-		c = (c<<24)|(c<<16)|(c<<8)|c;
-		asm volatile("cld; rep stosl\n"
-			:: "D" (v), "a" (c), "c" (n/4)
-			: "cc", "memory");
-	} else
+	p = v;
+	c &= 0xFF;
+	if (n >= SMALL) {
+		// store bytes until p is aligned, then whole words
+		m = -(uintptr_t) p & 3;
+		n -= m;
 		asm volatile("cld; rep stosb\n"
-			:: "D" (v), "a" (c), "c" (n)
+			: "+D" (p), "+c" (m) : "a" (c) : "cc", "memory");
+		m = n / 4;
+		asm volatile("rep stosl\n"
+			: "+D" (p), "+c" (m) : "a" (c * 0x01010101)
 			: "cc", "memory");
+		n %= 4;
+	}
+	asm volatile("cld; rep stosb\n"
+		: "+D" (p), "+c" (n) : "a" (c) : "cc", "memory");
 	return v;
 }
 
+// Copy n bytes forward from s to d, moving whole words from
+// where d becomes aligned.
+static void
+copyfwd(char *d, const char *s, size_t n)
+{
+	size_t m;
+
+	if (n >= SMALL) {
+		m = -(uintptr_t) d & 3;
+		n -= m;
+		asm volatile("cld; rep movsb\n"
+			: "+D" (d), "+S" (s), "+c" (m) :: "cc", "memory");
+		m = n / 4;
+		asm volatile("rep movsl\n"
+			: "+D" (d), "+S" (s), "+c" (m) :: "cc", "memory");
+		n %= 4;
+	}
+	asm volatile("cld; rep movsb\n"
+		: "+D" (d), "+S" (s), "+c" (n) :: "cc", "memory");
+}
+
 void *
 memmove(void *dst, const void *src, size_t n)
 {
 	const char *s;
 	char *d;
-	
+	size_t m;
+
 	s = src;
 	d = dst;
 	if (s < d && s + n > d) {
-		s += n;
-		d += n;
-		if ((int)s%4 == 0 && (int)d%4 == 0 && n%4 == 0)
-			asm volatile("std; rep movsl\n"
-				:: "D" (d-4), "S" (s-4), "c" (n/4) : "cc", "memory");
-		else
+		// Copy backward.  s and d point at the last byte to move,
+		// or, around movsl, at the last word.
+		s += n - 1;
+		d += n - 1;
+		if (n >= SMALL) {
+			// bytes down to where d+1 is aligned, then whole words
+			m = (uintptr_t) (d + 1) & 3;
+			n -= m;
 			asm volatile("std; rep movsb\n"
-				:: "D" (d-1), "S" (s-1), "c" (n) : "cc", "memory");
+				: "+D" (d), "+S" (s), "+c" (m) :: "cc", "memory");
+			s -= 3;
+			d -= 3;
+			m = n / 4;
+			asm volatile("rep movsl\n"
+				: "+D" (d), "+S" (s), "+c" (m) :: "cc", "memory");
+			s += 3;
+			d += 3;
+			n %= 4;
+		}
+		asm volatile("std; rep movsb\n"
+			: "+D" (d), "+S" (s), "+c" (n) :: "cc", "memory");
 		// Some versions of GCC rely on DF being clear
 		asm volatile("cld" ::: "cc");
-	} else {
-		if ((int)s%4 == 0 && (int)d%4 == 0 && n%4 == 0)
-			asm volatile("cld; rep movsl\n"
-				:: "D" (d), "S" (s), "c" (n/4) : "cc", "memory");
-		else
-			asm volatile("cld; rep movsb\n"
-				:: "D" (d), "S" (s), "c" (n) : "cc", "memory");
-	}
+	} else if (s + n <= d || d + n <= s)
+		// No overlap: the kernel may have put a faster memcpy
+		// in place for this CPU (kern/memops.c).
+		memcpy(d, s, n);
+	else
+		copyfwd(d, s, n);
+	return dst;
+}
+
+// Unlike memmove, the buffers must not overlap.
+// Never inlined, so that memmove's calls reach the entry that the
+// kernel may patch.
+__attribute__((noinline)) void *
+memcpy(void *dst, const void *src, size_t n)
+{
+	copyfwd(dst, src, n);
 	return dst;
 }
 
@@ -176,8 +253,6 @@ memset(void *v, int c, size_t n)
 	return v;
 }
 
-/* no memcpy - use memmove instead */
-
 void *
 memmove(void *dst, const void *src, size_t n)
 {
@@ -197,15 +272,20 @@ memmove(void *dst, const void *src, size_t n)
 
 	return dst;
 }
-#endif
 
-/* sigh - gcc emits references to this for structure assignments! */
-/* it is *not* prototyped in inc/string.h - do not use directly. */
 void *
-memcpy(void *dst, void *src, size_t n)
+memcpy(void *dst, const void *src, size_t n)
 {
-	return memmove(dst, src, n);
+	const char *s;
+	char *d;
+
+	s = src;
+	d = dst;
+	while (n-- > 0)
+		*d++ = *s++;
+	return dst;
 }
+#endif
 
 int
 memcmp(const void *v1, const void *v2, size_t n)
@@ -213,6 +293,14 @@ memcmp(const void *v1, const void *v2, size_t n)
 	const uint8_t *s1 = (const uint8_t *) v1;
 	const uint8_t *s2 = (const uint8_t *) v2;
 
+	// x86 allows unaligned loads, so skip equal words regardless
+	// of alignment; the byte loop then finds the difference.
+	while (n >= sizeof(word_t)
+	       && *(const word_t *) s1 == *(const word_t *) s2) {
+		s1 += sizeof(word_t), s2 += sizeof(word_t);
+		n -= sizeof(word_t);
+	}
+
 	while (n-- > 0) {
 		if (*s1 != *s2)
 			return (int) *s1 - (int) *s2;
@@ -225,11 +313,21 @@ memcmp(const void *v1, const void *v2, size_t n)
 void *
 memfind(const void *s, int c, size_t n)
 {
-	const void *ends = (const char *) s + n;
-	for (; s < ends; s++)
-		if (*(const unsigned char *) s == (unsigned char) c)
+	const unsigned char *p = s;
+	const unsigned char *ends = p + n;
+	uint32_t cs = (unsigned char) c * ONES;
+
+	for (; p < ends && !ALIGNED(p); p++)
+		if (*p == (unsigned char) c)
+			return (void *) p;
+	// skip whole words without a 'c'
+	for (; ends - p >= sizeof(word_t); p += sizeof(word_t))
+		if (HASZERO(*(const word_t *) p ^ cs))
+			break;
+	for (; p < ends; p++)
+		if (*p == (unsigned char) c)
 			break;
-	return (void *) s;
+	return (void *) p;
 }
 
 long